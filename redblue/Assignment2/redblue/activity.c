@@ -0,0 +1,232 @@
+#include "activity.h"
+#include <stdlib.h>
+
+/* Allocates the activity flags for a height x width subgrid, with every region active. */
+int mallocactivity(struct activity *act, int height, int width, int tilesize) {
+	act->height = height;
+	act->width = width;
+	act->tilesize = tilesize;
+	act->hash = NULL;
+	act->tilerows = (height + tilesize - 1) / tilesize;
+	act->tilecols = (width + tilesize - 1) / tilesize;
+	act->red = malloc(height * act->tilecols);
+	act->blue = malloc(width * act->tilerows);
+	act->bluetiles = calloc(act->tilerows * act->tilecols, sizeof(int));
+	act->solving = malloc(width);
+	act->solvingtiles = malloc(act->tilecols * sizeof(int));
+	act->arrivedrow = malloc(width * sizeof(int));
+	if (!act->red || !act->blue || !act->bluetiles || !act->solving || !act->solvingtiles || !act->arrivedrow) {
+		freeactivity(act);
+		return -1;
+	}
+	for (int x = 0; x < height * act->tilecols; x++) {
+		act->red[x] = 1;
+	}
+	for (int y = 0; y < width; y++) {
+		for (int tr = 0; tr < act->tilerows; tr++) {
+			act->blue[y * act->tilerows + tr] = 1;
+			act->bluetiles[tr * act->tilecols + y / tilesize]++;
+		}
+	}
+	return 0;
+}
+
+void freeactivity(struct activity *act) {
+	free(act->red);
+	free(act->blue);
+	free(act->bluetiles);
+	free(act->solving);
+	free(act->solvingtiles);
+	free(act->arrivedrow);
+	act->red = act->blue = act->solving = NULL;
+	act->bluetiles = act->solvingtiles = act->arrivedrow = NULL;
+}
+
+static void wakered(struct activity *act, int x, int y) {
+	act->red[x * act->tilecols + y / act->tilesize] = 1;
+}
+
+static void wakeblue(struct activity *act, int x, int y) {
+	unsigned char *flag = &act->blue[y * act->tilerows + x / act->tilesize];
+	if (!*flag) {
+		*flag = 1;
+		act->bluetiles[(x / act->tilesize) * act->tilecols + y / act->tilesize]++;
+	}
+}
+
+/* Called when cell (x, y) changes. The red row holding it and the one holding the cell to its left
+	may now move, as may the blue column holding it and the one holding the cell above it.
+	The last column and row are solved every turn, so nothing wraps here. */
+void wakecell(struct activity *act, int x, int y) {
+	wakered(act, x, y);
+	if (y > 0) {
+		wakered(act, x, y - 1);
+	}
+	wakeblue(act, x, y);
+	if (x > 0) {
+		wakeblue(act, x - 1, y);
+	}
+}
+
+/* Wakes the cells a neighbour moved into, as marked with a 3 in the buffer it sent back.
+	Red cars arrive down the left column, blue cars along the top row. */
+void wakebuffer(struct activity *act, int *buffer, int size, int color) {
+	for (int i = 0; i < size; i++) {
+		if (buffer[i] == 3) {
+			int x = color == 1 ? i : 0;
+			int y = color == 1 ? 0 : i;
+			wakecell(act, x, y);
+			if (act->hash) {
+				hashcell(act->hash, x, y, color);
+			}
+		}
+	}
+}
+
+/* Moves a car of the given color from (x, fromy) to (x, toy), keeping the counts and activity up to date. */
+static void moverow(int **subgrid, int x, int fromy, int toy, int color, struct activity *act, struct tilecounts *counts) {
+	subgrid[x][fromy] = 0;
+	subgrid[x][toy] = color;
+	wakecell(act, x, fromy);
+	wakecell(act, x, toy);
+	if (act->hash) {
+		hashcell(act->hash, x, fromy, color);
+		hashcell(act->hash, x, toy, color);
+	}
+	if (counts && fromy / act->tilesize != toy / act->tilesize) {
+		addtilecount(counts, color, x, fromy, -1);
+		addtilecount(counts, color, x, toy, 1);
+	}
+}
+
+/* Red turn solved in place without moved markers, visiting only the active rows of each tile.
+	A car that has just moved is skipped rather than marked, and the last column is solved every turn
+	since it depends on column 0 or the neighbour's buffer. Gives the same result as solverowturn. */
+void solverowturnactive(int **subgrid, int *rightbuffer, int height, int width, int color, struct activity *act, struct tilecounts *counts) {
+	for (int x = 0; x < height; x++) {
+		int *row = subgrid[x];
+		int skip = -1;									// Column holding a car that moved this turn
+		for (int tc = 0; tc < act->tilecols; tc++) {
+			unsigned char *flag = &act->red[x * act->tilecols + tc];
+			if (!*flag) {
+				continue;
+			}
+			*flag = 0;
+
+			int end = (tc + 1) * act->tilesize < width - 1 ? (tc + 1) * act->tilesize : width - 1;
+			for (int y = tc * act->tilesize; y < end; y++) {
+				if (y == skip) {
+					wakered(act, x, y);					// Arrived from the previous tile before it was solved
+				} else if (row[y] == color && row[y + 1] == 0) {
+					moverow(subgrid, x, y, y + 1, color, act, counts);
+					skip = y + 1;
+				}
+			}
+		}
+
+		int last = width - 1;
+		if (last != skip && row[last] == color) {
+			if (!rightbuffer) {
+				if (last > 0 && row[0] == 0) {			// Wrap against the new state of column 0
+					moverow(subgrid, x, last, 0, color, act, counts);
+				}
+			} else if (rightbuffer[x] == 0) {
+				rightbuffer[x] = 3;
+				row[last] = 0;
+				wakecell(act, x, last);
+				if (act->hash) {
+					hashcell(act->hash, x, last, color);
+				}
+				if (counts) {
+					addtilecount(counts, color, x, last, -1);
+				}
+			}
+		}
+	}
+}
+
+/* Moves a blue car from (fromx, y) to (tox, y), keeping the counts and activity up to date. */
+static void movecolumn(int **subgrid, int fromx, int tox, int y, struct activity *act, struct tilecounts *counts) {
+	subgrid[fromx][y] = 0;
+	subgrid[tox][y] = 2;
+	wakecell(act, fromx, y);
+	wakecell(act, tox, y);
+	if (act->hash) {
+		hashcell(act->hash, fromx, y, 2);
+		hashcell(act->hash, tox, y, 2);
+	}
+	if (counts && fromx / act->tilesize != tox / act->tilesize) {
+		addtilecount(counts, 2, fromx, y, -1);
+		addtilecount(counts, 2, tox, y, 1);
+	}
+}
+
+/* Blue turn solved in place without moved markers, visiting only the active columns of each tile.
+	Rows are solved top to bottom, remembering which row each column last had a car move into.
+	The bottom row is solved every turn. Gives the same result as solveblueturn. */
+void solveblueturnactive(int **subgrid, int *botbuffer, int height, int width, struct activity *act, struct tilecounts *counts) {
+	int tilesize = act->tilesize;
+	for (int y = 0; y < width; y++) {
+		act->arrivedrow[y] = -1;
+	}
+
+	for (int tr = 0; tr < act->tilerows; tr++) {
+		// Take the columns to solve in this tile row. Moves made while solving wake them for the next turn.
+		for (int tc = 0; tc < act->tilecols; tc++) {
+			int *tilecount = &act->bluetiles[tr * act->tilecols + tc];
+			int yend = (tc + 1) * tilesize < width ? (tc + 1) * tilesize : width;
+			act->solvingtiles[tc] = *tilecount;
+			if (!*tilecount) {
+				continue;
+			}
+			for (int y = tc * tilesize; y < yend; y++) {
+				unsigned char *flag = &act->blue[y * act->tilerows + tr];
+				act->solving[y] = *flag;
+				*flag = 0;
+			}
+			*tilecount = 0;
+		}
+
+		int xend = (tr + 1) * tilesize < height - 1 ? (tr + 1) * tilesize : height - 1;
+		for (int x = tr * tilesize; x < xend; x++) {
+			for (int tc = 0; tc < act->tilecols; tc++) {
+				if (!act->solvingtiles[tc]) {				// Whole tile is jammed
+					continue;
+				}
+				int yend = (tc + 1) * tilesize < width ? (tc + 1) * tilesize : width;
+				for (int y = tc * tilesize; y < yend; y++) {
+					if (!act->solving[y]) {
+						continue;
+					}
+					if (act->arrivedrow[y] == x) {
+						wakeblue(act, x, y);				// Arrived from the tile above before it was solved
+					} else if (subgrid[x][y] == 2 && subgrid[x + 1][y] == 0) {
+						movecolumn(subgrid, x, x + 1, y, act, counts);
+						act->arrivedrow[y] = x + 1;
+					}
+				}
+			}
+		}
+	}
+
+	int last = height - 1;
+	for (int y = 0; y < width; y++) {
+		if (act->arrivedrow[y] != last && subgrid[last][y] == 2) {
+			if (!botbuffer) {
+				if (last > 0 && subgrid[0][y] == 0) {		// Wrap against the new state of row 0
+					movecolumn(subgrid, last, 0, y, act, counts);
+				}
+			} else if (botbuffer[y] == 0) {
+				botbuffer[y] = 3;
+				subgrid[last][y] = 0;
+				wakecell(act, last, y);
+				if (act->hash) {
+					hashcell(act->hash, last, y, 2);
+				}
+				if (counts) {
+					addtilecount(counts, 2, last, y, -1);
+				}
+			}
+		}
+	}
+}
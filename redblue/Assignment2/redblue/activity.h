@@ -0,0 +1,37 @@
+#ifndef ACTIVITY_H
+#define ACTIVITY_H
+
+#include "tilecount.h"
+#include "boardhash.h"
+
+/* Marks which parts of a subgrid may still have moves, so jammed regions are skipped.
+	Red moves are tracked per row of each tile, blue moves per column of each tile, with a count
+	of the active columns in each tile so the row-by-row blue turn passes over whole jammed tiles. */
+struct activity {
+	int height;
+	int width;
+	int tilesize;
+	int tilerows;
+	int tilecols;
+	unsigned char *red;			// height * tilecols: row x of tile column tc may have red moves
+	unsigned char *blue;		// width * tilerows: column y of tile row tr may have blue moves
+	int *bluetiles;				// Active blue columns in each tile
+	unsigned char *solving;		// Blue columns of the current tile row being solved this turn
+	int *solvingtiles;			// Columns being solved in each tile of the current tile row
+	int *arrivedrow;			// Row a blue car last moved into, for each column
+	struct boardhash *hash;		// Updated for every move if set
+};
+
+int mallocactivity(struct activity *act, int height, int width, int tilesize);
+
+void freeactivity(struct activity *act);
+
+void wakecell(struct activity *act, int x, int y);
+
+void wakebuffer(struct activity *act, int *buffer, int size, int color);
+
+void solverowturnactive(int **subgrid, int *rightbuffer, int height, int width, int color, struct activity *act, struct tilecounts *counts);
+
+void solveblueturnactive(int **subgrid, int *botbuffer, int height, int width, struct activity *act, struct tilecounts *counts);
+
+#endif
@@ -0,0 +1,140 @@
+#include "balance.h"
+#include "redblueprocedure.h"
+#include <stdlib.h>
+
+/* Moves the boundaries between procs bands of tiles so each band gets about the same share of the
+	cost, cost[i] being the cost of tile i. bounds[p] is the first tile of band p and bounds[procs]
+	the number of tiles. A boundary goes where the cost before it passes its share, measured to the
+	middle of a tile, and every band keeps at least one tile. Returns 1 if any boundary moved. */
+int balancebounds(int *bounds, int procs, const double *cost, int tiles) {
+	double total = 0;
+	for (int i = 0; i < tiles; i++) {
+		total += cost[i];
+	}
+	int moved = 0;
+	int tile = 0;
+	double before = 0;					// Cost of the tiles before tile
+	for (int p = 1; p < procs; p++) {
+		double share = total * p / procs;
+		while (tile < tiles && before + cost[tile] / 2 < share) {
+			before += cost[tile++];
+		}
+		int lowest = bounds[p - 1] + 1, highest = tiles - (procs - p);
+		int bound = tile < lowest ? lowest : (tile > highest ? highest : tile);
+		while (tile < bound) {
+			before += cost[tile++];
+		}
+		while (tile > bound) {
+			before -= cost[--tile];
+		}
+		moved |= bounds[p] != bound;
+		bounds[p] = bound;
+	}
+	return moved;
+}
+
+/* Compares the compute time of every process since the last call. If the slowest took more than
+	REBALANCE_THRESHOLD times the mean, spreads each process's time evenly over its tile rows and tile
+	columns, adds them up across the torus and balances the row and column bounds on the totals.
+	Every process gets the same bounds. Returns 1 if they moved. */
+int measurebounds(int *rowbounds, int *colbounds, double cost, int tiledimension, MPI_Comm cartcomm) {
+	int dims[2], periods[2], coords[2];
+	MPI_Cart_get(cartcomm, 2, dims, periods, coords);
+	double slowest, total;
+	MPI_Allreduce(&cost, &slowest, 1, MPI_DOUBLE, MPI_MAX, cartcomm);
+	MPI_Allreduce(&cost, &total, 1, MPI_DOUBLE, MPI_SUM, cartcomm);
+	if (slowest <= REBALANCE_THRESHOLD * total / (dims[0] * dims[1])) {
+		return 0;
+	}
+
+	double *local = calloc(2 * tiledimension, sizeof(double));
+	double *costs = malloc(2 * tiledimension * sizeof(double));
+	int firstrow = rowbounds[coords[0]], lastrow = rowbounds[coords[0] + 1];
+	int firstcol = colbounds[coords[1]], lastcol = colbounds[coords[1] + 1];
+	for (int i = firstrow; i < lastrow; i++) {
+		local[i] = cost / (lastrow - firstrow);
+	}
+	for (int j = firstcol; j < lastcol; j++) {
+		local[tiledimension + j] = cost / (lastcol - firstcol);
+	}
+	MPI_Allreduce(local, costs, 2 * tiledimension, MPI_DOUBLE, MPI_SUM, cartcomm);
+	int moved = balancebounds(rowbounds, dims[0], costs, tiledimension);
+	moved |= balancebounds(colbounds, dims[1], costs + tiledimension, tiledimension);
+	free(local);
+	free(costs);
+	return moved;
+}
+
+/* The cells, in tiles, where the bands first..last of two splits overlap. */
+static int overlap(int first, int last, int otherfirst, int otherlast, int *start, int *size) {
+	*start = first > otherfirst ? first : otherfirst;
+	*size = (last < otherlast ? last : otherlast) - *start;
+	return *size > 0;
+}
+
+/* Makes a subarray type for a block of a rows x cols subgrid. Returns 1, the count to send it with. */
+static int blocktype(int rows, int cols, int startrow, int startcol, int height, int width, MPI_Datatype *type) {
+	int sizes[2] = { rows, cols }, subsizes[2] = { height, width }, starts[2] = { startrow, startcol };
+	MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_INT, type);
+	MPI_Type_commit(type);
+	return 1;
+}
+
+/* Moves the cells of the subgrids from the old row and column bounds, in tiles of t cells, to the
+	new ones. Each process sends every other one the part of its old subgrid that lies in the other's
+	new subgrid, which is only ever a neighbour's when a bound moves by less than a band. Replaces
+	*grid with the new subgrid. */
+int redistributesubgrid(int ***grid, const int *oldrows, const int *oldcols, const int *newrows, const int *newcols, int t, MPI_Comm cartcomm) {
+	int size, rank, coords[2];
+	MPI_Comm_size(cartcomm, &size);
+	MPI_Comm_rank(cartcomm, &rank);
+	MPI_Cart_coords(cartcomm, rank, 2, coords);
+	int oldheight = (oldrows[coords[0] + 1] - oldrows[coords[0]]) * t;
+	int oldwidth = (oldcols[coords[1] + 1] - oldcols[coords[1]]) * t;
+	int newheight = (newrows[coords[0] + 1] - newrows[coords[0]]) * t;
+	int newwidth = (newcols[coords[1] + 1] - newcols[coords[1]]) * t;
+	int **newgrid;
+	if (malloc2darray(&newgrid, newheight, newwidth) == -1) {
+		return -1;
+	}
+
+	int *sendcounts = malloc(size * sizeof(int));
+	int *recvcounts = malloc(size * sizeof(int));
+	int *displs = calloc(size, sizeof(int));
+	MPI_Datatype *sendtypes = malloc(size * sizeof(MPI_Datatype));
+	MPI_Datatype *recvtypes = malloc(size * sizeof(MPI_Datatype));
+	for (int q = 0; q < size; q++) {
+		int other[2], row, height, col, width;
+		MPI_Cart_coords(cartcomm, q, 2, other);
+		sendcounts[q] = recvcounts[q] = 0;
+		sendtypes[q] = recvtypes[q] = MPI_INT;
+		if (overlap(oldrows[coords[0]], oldrows[coords[0] + 1], newrows[other[0]], newrows[other[0] + 1], &row, &height)
+			&& overlap(oldcols[coords[1]], oldcols[coords[1] + 1], newcols[other[1]], newcols[other[1] + 1], &col, &width)) {
+			sendcounts[q] = blocktype(oldheight, oldwidth, (row - oldrows[coords[0]]) * t, (col - oldcols[coords[1]]) * t,
+				height * t, width * t, &sendtypes[q]);
+		}
+		if (overlap(newrows[coords[0]], newrows[coords[0] + 1], oldrows[other[0]], oldrows[other[0] + 1], &row, &height)
+			&& overlap(newcols[coords[1]], newcols[coords[1] + 1], oldcols[other[1]], oldcols[other[1] + 1], &col, &width)) {
+			recvcounts[q] = blocktype(newheight, newwidth, (row - newrows[coords[0]]) * t, (col - newcols[coords[1]]) * t,
+				height * t, width * t, &recvtypes[q]);
+		}
+	}
+	MPI_Alltoallw(&(*grid)[0][0], sendcounts, displs, sendtypes, &newgrid[0][0], recvcounts, displs, recvtypes, cartcomm);
+
+	for (int q = 0; q < size; q++) {
+		if (sendcounts[q]) {
+			MPI_Type_free(&sendtypes[q]);
+		}
+		if (recvcounts[q]) {
+			MPI_Type_free(&recvtypes[q]);
+		}
+	}
+	free(sendcounts);
+	free(recvcounts);
+	free(displs);
+	free(sendtypes);
+	free(recvtypes);
+	free2darray(grid);
+	*grid = newgrid;
+	return 0;
+}
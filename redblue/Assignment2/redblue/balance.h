@@ -0,0 +1,15 @@
+#ifndef BALANCE_H
+#define BALANCE_H
+
+#include <mpi.h>
+
+// Rebalance when the slowest process took this many times the mean compute time
+#define REBALANCE_THRESHOLD	1.2
+
+int balancebounds(int *bounds, int procs, const double *cost, int tiles);
+
+int measurebounds(int *rowbounds, int *colbounds, double cost, int tiledimension, MPI_Comm cartcomm);
+
+int redistributesubgrid(int ***grid, const int *oldrows, const int *oldcols, const int *newrows, const int *newcols, int t, MPI_Comm cartcomm);
+
+#endif
@@ -0,0 +1,211 @@
+#include "bitgrid.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Allocates zeroed bit planes for a height x width board. */
+int mallocbitgrid(struct bitgrid *bg, int height, int width) {
+	bg->height = height;
+	bg->width = width;
+	bg->words = (width + 63) / 64;
+	bg->hash = NULL;
+	bg->red = calloc(2 * height * bg->words, sizeof(uint64_t));
+	bg->blue = bg->red ? bg->red + height * bg->words : NULL;
+	bg->scratch = calloc(bg->words, sizeof(uint64_t));
+	if (!bg->red || !bg->scratch) {
+		freebitgrid(bg);
+		return -1;
+	}
+	return 0;
+}
+
+void freebitgrid(struct bitgrid *bg) {
+	free(bg->red);
+	free(bg->scratch);
+	bg->red = bg->blue = bg->scratch = NULL;
+}
+
+/* Sets the bit planes from an int grid of the same size. */
+void packbitgrid(struct bitgrid *bg, int **grid) {
+	for (int x = 0; x < bg->height; x++) {
+		uint64_t *red = bg->red + x * bg->words;
+		uint64_t *blue = bg->blue + x * bg->words;
+		for (int w = 0; w < bg->words; w++) {
+			red[w] = blue[w] = 0;
+		}
+		for (int y = 0; y < bg->width; y++) {
+			uint64_t bit = (uint64_t)1 << (y % 64);
+			if (grid[x][y] == 1) {
+				red[y / 64] |= bit;
+			} else if (grid[x][y] == 2) {
+				blue[y / 64] |= bit;
+			}
+		}
+	}
+}
+
+/* Toggles the hash for every car in a word of moved cars, which moved by (dx, dy). */
+static void hashmoves(struct boardhash *hash, uint64_t moved, int x, int firstcol, int dx, int dy, int color) {
+	while (moved) {
+		int y = firstcol + __builtin_ctzll(moved);
+		hashcell(hash, x, y, color);
+		hashcell(hash, x + dx, y + dy, color);
+		moved &= moved - 1;
+	}
+}
+
+/* Sets the hash with one full scan of the bit planes. */
+void fillbitgridhash(struct bitgrid *bg) {
+	bg->hash->hash = 0;
+	for (int x = 0; x < bg->height; x++) {
+		for (int w = 0; w < bg->words; w++) {
+			uint64_t red = bg->red[x * bg->words + w];
+			uint64_t blue = bg->blue[x * bg->words + w];
+			for (; red; red &= red - 1) {
+				hashcell(bg->hash, x, w * 64 + __builtin_ctzll(red), 1);
+			}
+			for (; blue; blue &= blue - 1) {
+				hashcell(bg->hash, x, w * 64 + __builtin_ctzll(blue), 2);
+			}
+		}
+	}
+}
+
+/* Writes the bit planes back into an int grid of the same size. */
+void unpackbitgrid(struct bitgrid *bg, int **grid) {
+	for (int x = 0; x < bg->height; x++) {
+		uint64_t *red = bg->red + x * bg->words;
+		uint64_t *blue = bg->blue + x * bg->words;
+		for (int y = 0; y < bg->width; y++) {
+			int shift = y % 64;
+			if ((red[y / 64] >> shift) & 1) {
+				grid[x][y] = 1;
+			} else if ((blue[y / 64] >> shift) & 1) {
+				grid[x][y] = 2;
+			} else {
+				grid[x][y] = 0;
+			}
+		}
+	}
+}
+
+/* Moves every red cell with a white cell to its right, a word at a time.
+	The wraparound move of the last column is made after the rest of the row, against the new
+	state of column 0, which is what solveredturn does when it has no buffer. */
+void bitsolveredturn(struct bitgrid *bg) {
+	int words = bg->words;
+	int lastword = (bg->width - 1) / 64;
+	uint64_t lastbit = (uint64_t)1 << ((bg->width - 1) % 64);
+
+	for (int x = 0; x < bg->height; x++) {
+		uint64_t *red = bg->red + x * words;
+		uint64_t *blue = bg->blue + x * words;
+		int wrap = (red[lastword] & lastbit) != 0;
+		uint64_t carry = 0;							// Cars moving from bit 63 of the previous word
+
+		for (int w = 0; w < words; w++) {
+			uint64_t occupied = (red[w] | blue[w]) >> 1;
+			if (w + 1 < words) {
+				occupied |= (red[w + 1] | blue[w + 1]) << 63;
+			}
+			uint64_t moved = red[w] & ~occupied;
+			if (w == lastword) {
+				moved &= ~lastbit;					// The last column only moves by wrapping
+			}
+			red[w] = (red[w] & ~moved) | (moved << 1) | carry;
+			carry = moved >> 63;
+			if (bg->hash) {
+				hashmoves(bg->hash, moved, x, w * 64, 0, 1, 1);
+			}
+		}
+
+		if (wrap && !((red[0] | blue[0]) & 1)) {
+			red[lastword] &= ~lastbit;
+			red[0] |= 1;
+			if (bg->hash) {
+				hashcell(bg->hash, x, bg->width - 1, 1);
+				hashcell(bg->hash, x, 0, 1);
+			}
+		}
+	}
+}
+
+/* Moves every blue cell with a white cell below it, a row of words at a time.
+	Rows are done top to bottom, so the row below is still in its old state when a row is solved,
+	and the wraparound move of the bottom row is made against the new state of the top row. */
+void bitsolveblueturn(struct bitgrid *bg) {
+	int words = bg->words;
+	int height = bg->height;
+	uint64_t *incoming = bg->scratch;				// Cars that moved down from the previous row
+
+	for (int w = 0; w < words; w++) {
+		incoming[w] = 0;
+	}
+	for (int x = 0; x < height - 1; x++) {
+		uint64_t *blue = bg->blue + x * words;
+		uint64_t *belowred = bg->red + (x + 1) * words;
+		uint64_t *belowblue = bg->blue + (x + 1) * words;
+		for (int w = 0; w < words; w++) {
+			uint64_t moved = blue[w] & ~(belowred[w] | belowblue[w]);
+			blue[w] = (blue[w] & ~moved) | incoming[w];
+			incoming[w] = moved;
+			if (bg->hash) {
+				hashmoves(bg->hash, moved, x, w * 64, 1, 0, 2);
+			}
+		}
+	}
+
+	uint64_t *lastblue = bg->blue + (height - 1) * words;
+	for (int w = 0; w < words; w++) {
+		uint64_t wrapped = lastblue[w] & ~(bg->red[w] | bg->blue[w]);
+		lastblue[w] = (lastblue[w] & ~wrapped) | incoming[w];
+		bg->blue[w] |= wrapped;
+		if (bg->hash) {
+			hashmoves(bg->hash, wrapped, height - 1, w * 64, 1 - height, 0, 2);
+		}
+	}
+}
+
+/* Counts the set bits of a row of words in columns [start, end). */
+static int countrange(uint64_t *row, int start, int end) {
+	int count = 0;
+	while (start < end) {
+		int w = start / 64;
+		int shift = start % 64;
+		int len = end - start < 64 - shift ? end - start : 64 - shift;
+		uint64_t mask = len == 64 ? ~(uint64_t)0 : (((uint64_t)1 << len) - 1) << shift;
+		count += __builtin_popcountll(row[w] & mask);
+		start += len;
+	}
+	return count;
+}
+
+/* Counts the red and blue cells in each tile, checking if any exceeds the threshold. Only whole
+	tiles are counted, and exceeding tiles are reported in the same order and format as counttiles. */
+int bitcounttiles(struct bitgrid *bg, int tilesize, int tiledimension, int maxcells) {
+	int tilecols = bg->width / tilesize;
+	int* numred = calloc(tilecols, sizeof(int));
+	int* numblue = calloc(tilecols, sizeof(int));
+	int result = 0;
+
+	for (int x = 0; x < bg->height; x++) {
+		uint64_t *red = bg->red + x * bg->words;
+		uint64_t *blue = bg->blue + x * bg->words;
+		for (int tile = 0; tile < tilecols; tile++) {
+			numred[tile] += countrange(red, tile * tilesize, (tile + 1) * tilesize);
+			numblue[tile] += countrange(blue, tile * tilesize, (tile + 1) * tilesize);
+		}
+		if ((x + 1) % tilesize == 0) {
+			for (int tile = 0; tile < tilecols; tile++) {
+				int tilenum = (x / tilesize) * tiledimension + tile;
+				if (numred[tile] >= maxcells || numblue[tile] >= maxcells) {
+					printf("Tile %d exceeded max @ red:%d, blue:%d\n", tilenum, numred[tile], numblue[tile]);
+					result = -1;
+				}
+				numred[tile] = numblue[tile] = 0;
+			}
+		}
+	}
+	free(numred);
+	free(numblue);
+	return result;
+}
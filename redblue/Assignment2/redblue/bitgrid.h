@@ -0,0 +1,36 @@
+#ifndef BITGRID_H
+#define BITGRID_H
+
+#include <stdint.h>
+#include "boardhash.h"
+
+/* A board stored as two bit planes, one bit per cell. Bit y % 64 of word y / 64 in a row holds column y.
+	Bits past the width in the last word of each row are always 0. Both planes are one allocation,
+	with blue straight after red. */
+struct bitgrid {
+	int height;
+	int width;
+	int words;				// Words per row
+	uint64_t *red;
+	uint64_t *blue;
+	uint64_t *scratch;		// One row of words, used by the blue turn
+	struct boardhash *hash;	// Updated for every move if set
+};
+
+int mallocbitgrid(struct bitgrid *bg, int height, int width);
+
+void freebitgrid(struct bitgrid *bg);
+
+void fillbitgridhash(struct bitgrid *bg);
+
+void packbitgrid(struct bitgrid *bg, int **grid);
+
+void unpackbitgrid(struct bitgrid *bg, int **grid);
+
+void bitsolveredturn(struct bitgrid *bg);
+
+void bitsolveblueturn(struct bitgrid *bg);
+
+int bitcounttiles(struct bitgrid *bg, int tilesize, int tiledimension, int maxcells);
+
+#endif
@@ -0,0 +1,89 @@
+#include "boardhash.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Mixes a 64-bit value (splitmix64), giving a key for each cell and color without a table. */
+static uint64_t mix(uint64_t z) {
+	z += 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+void initboardhash(struct boardhash *bh, int toprowindex, int leftcolindex, int n) {
+	bh->hash = 0;
+	bh->toprowindex = toprowindex;
+	bh->leftcolindex = leftcolindex;
+	bh->n = n;
+}
+
+/* Toggles the key for a car of the given color at local cell (x, y). A move is two calls. */
+void hashcell(struct boardhash *bh, int x, int y, int color) {
+	uint64_t cell = (uint64_t)(bh->toprowindex + x) * bh->n + (bh->leftcolindex + y);
+	bh->hash ^= mix(cell * 2 + color);
+}
+
+/* Sets the hash with one full scan of the subgrid. */
+void fillboardhash(struct boardhash *bh, int **grid, int height, int width) {
+	bh->hash = 0;
+	for (int x = 0; x < height; x++) {
+		for (int y = 0; y < width; y++) {
+			if (grid[x][y] == 1 || grid[x][y] == 2) {
+				hashcell(bh, x, y, grid[x][y]);
+			}
+		}
+	}
+}
+
+/* Allocates room to save size bytes of local state. */
+int mallocdetector(struct cycledetector *cd, size_t size) {
+	cd->savediter = -1;
+	cd->power = 1;
+	cd->size = size;
+	cd->snapshot = malloc(size);
+	return cd->snapshot ? 0 : -1;
+}
+
+void freedetector(struct cycledetector *cd) {
+	free(cd->snapshot);
+	cd->snapshot = NULL;
+}
+
+/* Called after each iteration with the hash of the whole board. If it matches the saved board, the
+	states are compared in full on every process, so a hash collision can't end a run early.
+	Returns the period once a repeat is confirmed, or 0. Every process must make the same calls. */
+int checkcycle(struct cycledetector *cd, uint64_t hash, int iter, void *state, MPI_Comm comm) {
+	if (cd->savediter >= 0 && hash == cd->savedhash) {
+		int same = memcmp(state, cd->snapshot, cd->size) == 0;
+		int allsame = 0;
+		MPI_Allreduce(&same, &allsame, 1, MPI_INT, MPI_LAND, comm);
+		if (allsame) {
+			return iter - cd->savediter;
+		}
+	}
+	if (cd->savediter < 0 || iter - cd->savediter == cd->power) {
+		if (cd->savediter >= 0) {
+			cd->power *= 2;
+		}
+		cd->savedhash = hash;
+		cd->savediter = iter;
+		memcpy(cd->snapshot, state, cd->size);
+	}
+	return 0;
+}
+
+/* Combines pairs of (tiles exceeded flag, board hash): the flags are ORed and the hashes XORed,
+	so the tile check and the board hash share one reduction. */
+static void reduceiteration(void *in, void *inout, int *len, MPI_Datatype *type) {
+	(void)type;						// Always MPI_UINT64_T
+	uint64_t *a = in;
+	uint64_t *b = inout;
+	for (int i = 0; i + 1 < *len; i += 2) {
+		b[i] |= a[i];
+		b[i + 1] ^= a[i + 1];
+	}
+}
+
+void createiterationop(MPI_Op *op) {
+	MPI_Op_create(reduceiteration, 1, op);
+}
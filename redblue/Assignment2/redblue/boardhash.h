@@ -0,0 +1,41 @@
+#ifndef BOARDHASH_H
+#define BOARDHASH_H
+
+#include <mpi.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Zobrist hash of a subgrid: the XOR of a key for each car, keyed by its global cell and color.
+	XORing the hashes of every subgrid gives the hash of the whole board. */
+struct boardhash {
+	uint64_t hash;
+	int toprowindex;			// Global index of local row 0 and column 0
+	int leftcolindex;
+	int n;						// Size of the whole grid
+};
+
+/* Finds a repeated board with Brent's method: the board is saved at iterations 1, 2, 4, 8, ...
+	and each later board is compared against the saved one. */
+struct cycledetector {
+	uint64_t savedhash;
+	int savediter;
+	int power;
+	void *snapshot;				// Copy of the local state at savediter
+	size_t size;
+};
+
+void initboardhash(struct boardhash *bh, int toprowindex, int leftcolindex, int n);
+
+void fillboardhash(struct boardhash *bh, int **grid, int height, int width);
+
+void hashcell(struct boardhash *bh, int x, int y, int color);
+
+int mallocdetector(struct cycledetector *cd, size_t size);
+
+void freedetector(struct cycledetector *cd);
+
+int checkcycle(struct cycledetector *cd, uint64_t hash, int iter, void *state, MPI_Comm comm);
+
+void createiterationop(MPI_Op *op);
+
+#endif
@@ -0,0 +1,197 @@
+#include "boardio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Packs the rows x cols subgrid into whole tiles of tilebytes, in the order they have in the file. */
+static void packtiles(int **grid, int rows, int cols, int t, int tilebytes, unsigned char *buf) {
+	for (int tilerow = 0; tilerow < rows / t; tilerow++) {
+		for (int tilecol = 0; tilecol < cols / t; tilecol++) {
+			unsigned char *tile = buf;
+			for (int x = 0; x < t; x++) {
+				int *row = grid[tilerow * t + x] + tilecol * t;
+				for (int y = 0; y < t; y++) {
+					int cell = x * t + y;
+					tile[cell / 4] |= (unsigned char)(row[y] << (2 * (cell % 4)));
+				}
+			}
+			buf += tilebytes;
+		}
+	}
+}
+
+/* Writes the board with collective MPI-IO, each process of comm giving its subgrid of whole tiles with
+	(toprow, leftcol) as its top left cell. The file view makes the subgrid a subarray of the board's
+	tiles, so every process writes its tiles in one call. n has to be a multiple of t.
+	Returns -1 if the file can't be written. */
+int writeboardfile(const char *path, int **grid, int rows, int cols, int toprow, int leftcol, int n, int t, int iteration, long long seed, MPI_Comm comm) {
+	int rank;
+	MPI_Comm_rank(comm, &rank);
+	int tilebytes = (t * t + 3) / 4;
+	int numtiles = (rows / t) * (cols / t);
+	unsigned char *buf = calloc((size_t)numtiles * tilebytes, 1);
+	if (!buf) {
+		return -1;
+	}
+	packtiles(grid, rows, cols, t, tilebytes, buf);
+
+	MPI_File fh;
+	if (MPI_File_open(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+		free(buf);
+		return -1;
+	}
+	MPI_File_set_size(fh, 0);
+
+	struct boardheader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BOARDMAGIC, sizeof(header.magic));
+	header.n = n;
+	header.t = t;
+	header.iteration = iteration;
+	header.seed = seed;
+	int headerresult = MPI_File_write_at_all(fh, 0, &header, rank == 0 ? sizeof(header) : 0, MPI_BYTE, MPI_STATUS_IGNORE);
+
+	MPI_Datatype tile, blocks;
+	int sizes[2] = { n / t, n / t }, subsizes[2] = { rows / t, cols / t }, starts[2] = { toprow / t, leftcol / t };
+	MPI_Type_contiguous(tilebytes, MPI_BYTE, &tile);
+	MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, tile, &blocks);
+	MPI_Type_commit(&tile);
+	MPI_Type_commit(&blocks);
+	MPI_File_set_view(fh, sizeof(header), tile, blocks, "native", MPI_INFO_NULL);
+	int result = MPI_File_write_all(fh, buf, numtiles, tile, MPI_STATUS_IGNORE);
+	MPI_File_close(&fh);
+	MPI_Type_free(&tile);
+	MPI_Type_free(&blocks);
+	free(buf);
+	return headerresult == MPI_SUCCESS && result == MPI_SUCCESS ? 0 : -1;
+}
+
+/* Writes a checkpoint to path by way of path.tmp, renamed once every process has written its tiles,
+	so a run killed while writing leaves the last checkpoint whole. Returns -1 if it can't be written. */
+int writecheckpoint(const char *path, int **grid, int rows, int cols, int toprow, int leftcol, int n, int t, int iteration, long long seed, MPI_Comm comm) {
+	int rank;
+	MPI_Comm_rank(comm, &rank);
+	char *temppath = malloc(strlen(path) + 5);
+	if (!temppath) {
+		return -1;
+	}
+	sprintf(temppath, "%s.tmp", path);
+	int result = writeboardfile(temppath, grid, rows, cols, toprow, leftcol, n, t, iteration, seed, comm);
+	if (result == 0 && rank == 0) {
+		result = rename(temppath, path) == 0 ? 0 : -1;
+	}
+	MPI_Bcast(&result, 1, MPI_INT, 0, comm);
+	free(temppath);
+	return result;
+}
+
+/* Reads the cells of a rows x cols subgrid from a binary board file. The file's tiles need not match
+	the run's, so each process reads the tiles covering its subgrid through a file view and takes the
+	cells it needs from them. */
+static int readboardtiles(MPI_File fh, struct boardheader *header, int **grid, int rows, int cols, int toprow, int leftcol) {
+	int ft = header->t;
+	int tilebytes = (ft * ft + 3) / 4;
+	int firstrow = toprow / ft, lastrow = (toprow + rows - 1) / ft;
+	int firstcol = leftcol / ft, lastcol = (leftcol + cols - 1) / ft;
+	int tilecols = lastcol - firstcol + 1;
+	int numtiles = (lastrow - firstrow + 1) * tilecols;
+	unsigned char *buf = malloc((size_t)numtiles * tilebytes);
+	if (!buf) {
+		return -1;
+	}
+
+	MPI_Datatype tile, blocks;
+	int sizes[2] = { header->n / ft, header->n / ft }, subsizes[2] = { lastrow - firstrow + 1, tilecols }, starts[2] = { firstrow, firstcol };
+	MPI_Type_contiguous(tilebytes, MPI_BYTE, &tile);
+	MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, tile, &blocks);
+	MPI_Type_commit(&tile);
+	MPI_Type_commit(&blocks);
+	MPI_File_set_view(fh, sizeof(struct boardheader), tile, blocks, "native", MPI_INFO_NULL);
+	int result = MPI_File_read_all(fh, buf, numtiles, tile, MPI_STATUS_IGNORE) == MPI_SUCCESS ? 0 : -1;
+	MPI_Type_free(&tile);
+	MPI_Type_free(&blocks);
+
+	for (int x = 0; x < rows; x++) {
+		int row = toprow + x;
+		for (int y = 0; y < cols; y++) {
+			int col = leftcol + y;
+			unsigned char *cells = buf + ((row / ft - firstrow) * tilecols + col / ft - firstcol) * tilebytes;
+			int cell = (row % ft) * ft + col % ft;
+			grid[x][y] = (cells[cell / 4] >> (2 * (cell % 4))) & 3;
+			if (grid[x][y] == 3) {
+				result = -1;
+			}
+		}
+	}
+	free(buf);
+	return result;
+}
+
+/* Reads the cells of a rows x cols subgrid from a text board, n lines of n digits as print_grid writes
+	them. The view is the subgrid's block of the n x (n + 1) characters. */
+static int readboardtext(MPI_File fh, int **grid, int rows, int cols, int toprow, int leftcol, int n) {
+	char *buf = malloc((size_t)rows * cols);
+	if (!buf) {
+		return -1;
+	}
+	MPI_Datatype block;
+	int sizes[2] = { n, n + 1 }, subsizes[2] = { rows, cols }, starts[2] = { toprow, leftcol };
+	MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_CHAR, &block);
+	MPI_Type_commit(&block);
+	MPI_File_set_view(fh, 0, MPI_CHAR, block, "native", MPI_INFO_NULL);
+	int result = MPI_File_read_all(fh, buf, rows * cols, MPI_CHAR, MPI_STATUS_IGNORE) == MPI_SUCCESS ? 0 : -1;
+	MPI_Type_free(&block);
+
+	for (int x = 0; x < rows; x++) {
+		for (int y = 0; y < cols; y++) {
+			char cell = buf[x * cols + y];
+			if (cell < '0' || cell > '2') {
+				result = -1;
+			}
+			grid[x][y] = cell - '0';
+		}
+	}
+	free(buf);
+	return result;
+}
+
+/* Reads this process's subgrid of an n x n board, from a file written by writeboardfile or a text
+	board of n lines of n digits. The header is filled in from the file, with iteration 0 and seed -1
+	for a text board. Any number of processes can read a file, whatever wrote it.
+	Returns -1 on every process if the file can't be read or doesn't hold an n x n board. */
+int readboardfile(const char *path, int **grid, int rows, int cols, int toprow, int leftcol, int n, struct boardheader *header, MPI_Comm comm) {
+	MPI_File fh;
+	if (MPI_File_open(comm, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+		return -1;
+	}
+	MPI_Offset size;
+	MPI_File_get_size(fh, &size);
+	memset(header, 0, sizeof(*header));
+	int result = -1;
+	if (size >= (MPI_Offset)sizeof(*header)) {
+		MPI_File_read_at_all(fh, 0, header, sizeof(*header), MPI_BYTE, MPI_STATUS_IGNORE);
+	}
+
+	if (memcmp(header->magic, BOARDMAGIC, sizeof(header->magic)) == 0) {
+		MPI_Offset expected = 0;
+		if (header->t > 0 && header->n % header->t == 0) {
+			MPI_Offset tiles = (MPI_Offset)(header->n / header->t) * (header->n / header->t);
+			expected = sizeof(*header) + tiles * ((header->t * header->t + 3) / 4);
+		}
+		if (header->n == n && size == expected) {
+			result = readboardtiles(fh, header, grid, rows, cols, toprow, leftcol);
+		}
+	} else if (size == (MPI_Offset)n * (n + 1)) {
+		memcpy(header->magic, BOARDMAGIC, sizeof(header->magic));
+		header->n = n;
+		header->t = 0;
+		header->iteration = 0;
+		header->seed = -1;
+		result = readboardtext(fh, grid, rows, cols, toprow, leftcol, n);
+	}
+	MPI_File_close(&fh);
+
+	int allresult;
+	MPI_Allreduce(&result, &allresult, 1, MPI_INT, MPI_MIN, comm);
+	return allresult;
+}
@@ -0,0 +1,27 @@
+#ifndef BOARDIO_H
+#define BOARDIO_H
+
+#include <mpi.h>
+#include <stdint.h>
+
+/* Binary board file: this header, then the tiles of the board in row-major order. Each tile holds its
+	cells in row-major order at 2 bits per cell (0 white, 1 red, 2 blue), the first cell in the low bits
+	of a byte, padded to a whole byte. Numbers are in the byte order of the machine that wrote them. */
+#define BOARDMAGIC	"RBBOARD1"
+
+struct boardheader {
+	char magic[8];
+	int32_t n;
+	int32_t t;
+	int32_t iteration;			// Iterations run to reach this board
+	int32_t reserved;
+	int64_t seed;				// Seed of the starting board
+};
+
+int writeboardfile(const char *path, int **grid, int rows, int cols, int toprow, int leftcol, int n, int t, int iteration, long long seed, MPI_Comm comm);
+
+int writecheckpoint(const char *path, int **grid, int rows, int cols, int toprow, int leftcol, int n, int t, int iteration, long long seed, MPI_Comm comm);
+
+int readboardfile(const char *path, int **grid, int rows, int cols, int toprow, int leftcol, int n, struct boardheader *header, MPI_Comm comm);
+
+#endif
@@ -0,0 +1,259 @@
+#include "bytegrid.h"
+#include <immintrin.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Solves the red turn for columns [start, end) of a row, reading the old cells from old.
+	Every column in the range must have a column on each side. */
+typedef void (*redrowfn)(uint8_t *row, const uint8_t *old, int start, int end);
+
+/* Solves the blue turn for one row, given the old rows above, at and below it. */
+typedef void (*bluerowfn)(uint8_t *row, const uint8_t *above, const uint8_t *cur, const uint8_t *below, int width);
+
+static void redrowscalar(uint8_t *row, const uint8_t *old, int start, int end) {
+	for (int y = start; y < end; y++) {
+		int out = (old[y] == 1) & (old[y + 1] == 0);
+		int in = (old[y - 1] == 1) & (old[y] == 0);
+		row[y] = (old[y] & -(uint8_t)!out) | (uint8_t)in;
+	}
+}
+
+static void bluerowscalar(uint8_t *row, const uint8_t *above, const uint8_t *cur, const uint8_t *below, int width) {
+	for (int y = 0; y < width; y++) {
+		int out = (cur[y] == 2) & (below[y] == 0);
+		int in = (above[y] == 2) & (cur[y] == 0);
+		row[y] = (cur[y] & -(uint8_t)!out) | (uint8_t)(in << 1);
+	}
+}
+
+__attribute__((target("avx2")))
+static void redrowavx2(uint8_t *row, const uint8_t *old, int start, int end) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi8(1);
+	int y = start;
+	for (; y + 32 <= end; y += 32) {
+		__m256i left = _mm256_loadu_si256((const __m256i *)(old + y - 1));
+		__m256i cell = _mm256_loadu_si256((const __m256i *)(old + y));
+		__m256i right = _mm256_loadu_si256((const __m256i *)(old + y + 1));
+		__m256i out = _mm256_and_si256(_mm256_cmpeq_epi8(cell, one), _mm256_cmpeq_epi8(right, zero));
+		__m256i in = _mm256_and_si256(_mm256_cmpeq_epi8(left, one), _mm256_cmpeq_epi8(cell, zero));
+		__m256i result = _mm256_or_si256(_mm256_andnot_si256(out, cell), _mm256_and_si256(in, one));
+		_mm256_storeu_si256((__m256i *)(row + y), result);
+	}
+	redrowscalar(row, old, y, end);
+}
+
+__attribute__((target("avx2")))
+static void bluerowavx2(uint8_t *row, const uint8_t *above, const uint8_t *cur, const uint8_t *below, int width) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i two = _mm256_set1_epi8(2);
+	int y = 0;
+	for (; y + 32 <= width; y += 32) {
+		__m256i up = _mm256_loadu_si256((const __m256i *)(above + y));
+		__m256i cell = _mm256_loadu_si256((const __m256i *)(cur + y));
+		__m256i down = _mm256_loadu_si256((const __m256i *)(below + y));
+		__m256i out = _mm256_and_si256(_mm256_cmpeq_epi8(cell, two), _mm256_cmpeq_epi8(down, zero));
+		__m256i in = _mm256_and_si256(_mm256_cmpeq_epi8(up, two), _mm256_cmpeq_epi8(cell, zero));
+		__m256i result = _mm256_or_si256(_mm256_andnot_si256(out, cell), _mm256_and_si256(in, two));
+		_mm256_storeu_si256((__m256i *)(row + y), result);
+	}
+	bluerowscalar(row + y, above + y, cur + y, below + y, width - y);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void redrowavx512(uint8_t *row, const uint8_t *old, int start, int end) {
+	const __m512i zero = _mm512_setzero_si512();
+	const __m512i one = _mm512_set1_epi8(1);
+	int y = start;
+	for (; y + 64 <= end; y += 64) {
+		__m512i left = _mm512_loadu_si512(old + y - 1);
+		__m512i cell = _mm512_loadu_si512(old + y);
+		__m512i right = _mm512_loadu_si512(old + y + 1);
+		__mmask64 out = _mm512_cmpeq_epi8_mask(cell, one) & _mm512_cmpeq_epi8_mask(right, zero);
+		__mmask64 in = _mm512_cmpeq_epi8_mask(left, one) & _mm512_cmpeq_epi8_mask(cell, zero);
+		__m512i result = _mm512_mask_mov_epi8(_mm512_mask_mov_epi8(cell, out, zero), in, one);
+		_mm512_storeu_si512(row + y, result);
+	}
+	redrowscalar(row, old, y, end);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void bluerowavx512(uint8_t *row, const uint8_t *above, const uint8_t *cur, const uint8_t *below, int width) {
+	const __m512i zero = _mm512_setzero_si512();
+	const __m512i two = _mm512_set1_epi8(2);
+	int y = 0;
+	for (; y + 64 <= width; y += 64) {
+		__m512i up = _mm512_loadu_si512(above + y);
+		__m512i cell = _mm512_loadu_si512(cur + y);
+		__m512i down = _mm512_loadu_si512(below + y);
+		__mmask64 out = _mm512_cmpeq_epi8_mask(cell, two) & _mm512_cmpeq_epi8_mask(down, zero);
+		__mmask64 in = _mm512_cmpeq_epi8_mask(up, two) & _mm512_cmpeq_epi8_mask(cell, zero);
+		__m512i result = _mm512_mask_mov_epi8(_mm512_mask_mov_epi8(cell, out, zero), in, two);
+		_mm512_storeu_si512(row + y, result);
+	}
+	bluerowscalar(row + y, above + y, cur + y, below + y, width - y);
+}
+
+static redrowfn redrow = NULL;
+static bluerowfn bluerow = NULL;
+static const char *isa = NULL;
+
+/* Picks the widest row kernels this CPU supports. */
+static void selectkernels(void) {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512bw")) {
+		redrow = redrowavx512;
+		bluerow = bluerowavx512;
+		isa = "avx512";
+	} else if (__builtin_cpu_supports("avx2")) {
+		redrow = redrowavx2;
+		bluerow = bluerowavx2;
+		isa = "avx2";
+	} else {
+		redrow = redrowscalar;
+		bluerow = bluerowscalar;
+		isa = "scalar";
+	}
+}
+
+/* Returns the name of the instruction set the turns run with. */
+const char *bytegridisa(void) {
+	if (!isa) {
+		selectkernels();
+	}
+	return isa;
+}
+
+int mallocbytegrid(struct bytegrid *bg, int height, int width) {
+	if (!isa) {
+		selectkernels();
+	}
+	bg->height = height;
+	bg->width = width;
+	bg->cells = malloc(height * width);
+	bg->saved = malloc(2 * width);
+	bg->blocked = malloc(width);
+	bg->empty = calloc(width, 1);
+	if (!bg->cells || !bg->saved || !bg->blocked || !bg->empty) {
+		freebytegrid(bg);
+		return -1;
+	}
+	memset(bg->blocked, 0xff, width);
+	return 0;
+}
+
+void freebytegrid(struct bytegrid *bg) {
+	free(bg->cells);
+	free(bg->saved);
+	free(bg->blocked);
+	free(bg->empty);
+	bg->cells = bg->saved = bg->blocked = bg->empty = NULL;
+}
+
+void packbytegrid(struct bytegrid *bg, int **grid) {
+	for (int x = 0; x < bg->height; x++) {
+		for (int y = 0; y < bg->width; y++) {
+			bg->cells[x * bg->width + y] = (uint8_t)grid[x][y];
+		}
+	}
+}
+
+void unpackbytegrid(struct bytegrid *bg, int **grid) {
+	for (int x = 0; x < bg->height; x++) {
+		for (int y = 0; y < bg->width; y++) {
+			grid[x][y] = bg->cells[x * bg->width + y];
+		}
+	}
+}
+
+/* Moves every red cell with a white cell to its right. Each row is copied aside so the kernels
+	read old cells only. The wraparound move is made against the new state of column 0, as
+	solveredturn does when it has no buffer. */
+void bytesolveredturn(struct bytegrid *bg) {
+	int width = bg->width;
+	uint8_t *old = bg->saved;
+
+	if (width < 2) {
+		return;
+	}
+	for (int x = 0; x < bg->height; x++) {
+		uint8_t *row = bg->cells + x * width;
+		memcpy(old, row, width);
+		redrow(row, old, 1, width - 1);
+		if (old[0] == 1 && old[1] == 0) {
+			row[0] = 0;
+		}
+		if (old[width - 2] == 1 && old[width - 1] == 0) {
+			row[width - 1] = 1;
+		}
+		if (old[width - 1] == 1 && row[0] == 0) {
+			row[width - 1] = 0;
+			row[0] = 1;
+		}
+	}
+}
+
+/* Moves every blue cell with a white cell below it. Rows are solved top to bottom, keeping the
+	old copy of the row above, and the bottom row wraps against the new state of the top row. */
+void bytesolveblueturn(struct bytegrid *bg) {
+	int width = bg->width;
+	int height = bg->height;
+	uint8_t *above = bg->empty;
+	uint8_t *cur = bg->saved;
+	uint8_t *spare = bg->saved + width;
+
+	if (height < 2) {
+		return;
+	}
+	for (int x = 0; x < height; x++) {
+		uint8_t *row = bg->cells + x * width;
+		uint8_t *below = x < height - 1 ? row + width : bg->blocked;
+		memcpy(cur, row, width);
+		bluerow(row, above, cur, below, width);
+		above = cur;
+		cur = spare;
+		spare = above;
+	}
+
+	uint8_t *top = bg->cells;
+	uint8_t *bottom = bg->cells + (height - 1) * width;
+	for (int y = 0; y < width; y++) {
+		if (above[y] == 2 && top[y] == 0) {			// above holds the old bottom row
+			bottom[y] = 0;
+			top[y] = 2;
+		}
+	}
+}
+
+/* Counts the red and blue cells in each tile, checking if any exceeds the threshold. Only whole
+	tiles are counted, and exceeding tiles are reported in the same order and format as counttiles. */
+int bytecounttiles(struct bytegrid *bg, int tilesize, int tiledimension, int maxcells) {
+	int tilecols = bg->width / tilesize;
+	int* numred = calloc(tilecols, sizeof(int));
+	int* numblue = calloc(tilecols, sizeof(int));
+	int result = 0;
+
+	for (int x = 0; x < bg->height; x++) {
+		uint8_t *row = bg->cells + x * bg->width;
+		for (int tile = 0; tile < tilecols; tile++) {
+			for (int y = tile * tilesize; y < (tile + 1) * tilesize; y++) {
+				numred[tile] += row[y] == 1;
+				numblue[tile] += row[y] == 2;
+			}
+		}
+		if ((x + 1) % tilesize == 0) {
+			for (int tile = 0; tile < tilecols; tile++) {
+				int tilenum = (x / tilesize) * tiledimension + tile;
+				if (numred[tile] >= maxcells || numblue[tile] >= maxcells) {
+					printf("Tile %d exceeded max @ red:%d, blue:%d\n", tilenum, numred[tile], numblue[tile]);
+					result = -1;
+				}
+				numred[tile] = numblue[tile] = 0;
+			}
+		}
+	}
+	free(numred);
+	free(numblue);
+	return result;
+}
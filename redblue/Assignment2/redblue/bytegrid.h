@@ -0,0 +1,33 @@
+#ifndef BYTEGRID_H
+#define BYTEGRID_H
+
+#include <stdint.h>
+
+/* A board stored as one byte per cell, using the same 0/1/2 values as the int grid.
+	The turns use AVX-512 or AVX2 when the CPU has them, and a branch-free scalar loop otherwise. */
+struct bytegrid {
+	int height;
+	int width;
+	uint8_t *cells;			// height * width cells, row-major
+	uint8_t *saved;			// Two rows of old cells kept while a turn overwrites them
+	uint8_t *blocked;		// A row that no car can move into
+	uint8_t *empty;			// A row with no cars in it
+};
+
+int mallocbytegrid(struct bytegrid *bg, int height, int width);
+
+void freebytegrid(struct bytegrid *bg);
+
+void packbytegrid(struct bytegrid *bg, int **grid);
+
+void unpackbytegrid(struct bytegrid *bg, int **grid);
+
+void bytesolveredturn(struct bytegrid *bg);
+
+void bytesolveblueturn(struct bytegrid *bg);
+
+int bytecounttiles(struct bytegrid *bg, int tilesize, int tiledimension, int maxcells);
+
+const char *bytegridisa(void);
+
+#endif
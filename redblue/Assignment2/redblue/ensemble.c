@@ -0,0 +1,193 @@
+#include "ensemble.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Allocates numboards (at most 64) empty boards of height x width. */
+int mallocensemble(struct ensemble *eg, int height, int width, int numboards, int firstboard) {
+	eg->height = height;
+	eg->width = width;
+	eg->numboards = numboards;
+	eg->firstboard = firstboard;
+	eg->red = calloc(2 * height * width, sizeof(uint64_t));
+	eg->blue = eg->red ? eg->red + height * width : NULL;
+	eg->scratch = calloc(width, sizeof(uint64_t));
+	if (!eg->red || !eg->scratch) {
+		freeensemble(eg);
+		return -1;
+	}
+	return 0;
+}
+
+void freeensemble(struct ensemble *eg) {
+	free(eg->red);
+	free(eg->scratch);
+	eg->red = eg->blue = eg->scratch = NULL;
+}
+
+/* Sets the bit of one board from an int grid of the same size. */
+void packensembleboard(struct ensemble *eg, int board, int **grid) {
+	uint64_t bit = (uint64_t)1 << board;
+	for (int x = 0; x < eg->height; x++) {
+		uint64_t *red = eg->red + x * eg->width;
+		uint64_t *blue = eg->blue + x * eg->width;
+		for (int y = 0; y < eg->width; y++) {
+			red[y] = grid[x][y] == 1 ? red[y] | bit : red[y] & ~bit;
+			blue[y] = grid[x][y] == 2 ? blue[y] | bit : blue[y] & ~bit;
+		}
+	}
+}
+
+/* Writes one board back into an int grid of the same size. */
+void unpackensembleboard(struct ensemble *eg, int board, int **grid) {
+	for (int x = 0; x < eg->height; x++) {
+		uint64_t *red = eg->red + x * eg->width;
+		uint64_t *blue = eg->blue + x * eg->width;
+		for (int y = 0; y < eg->width; y++) {
+			if ((red[y] >> board) & 1) {
+				grid[x][y] = 1;
+			} else if ((blue[y] >> board) & 1) {
+				grid[x][y] = 2;
+			} else {
+				grid[x][y] = 0;
+			}
+		}
+	}
+}
+
+/* Moves every red car of the live boards with a white cell to its right. As in bitsolveredturn, the
+	last column wraps after the rest of the row, against the new state of column 0.
+	Returns the boards in which a car moved. */
+uint64_t ensemblesolveredturn(struct ensemble *eg, uint64_t live) {
+	int width = eg->width;
+	uint64_t moved = 0;
+
+	for (int x = 0; x < eg->height; x++) {
+		uint64_t *red = eg->red + x * width;
+		uint64_t *blue = eg->blue + x * width;
+		uint64_t wrap = red[width - 1];			// Cars that can only move by wrapping
+		uint64_t incoming = 0;					// Cars moving in from the cell to the left
+
+		for (int y = 0; y < width - 1; y++) {
+			uint64_t moving = red[y] & ~(red[y + 1] | blue[y + 1]) & live;
+			red[y] = (red[y] & ~moving) | incoming;
+			incoming = moving;
+			moved |= moving;
+		}
+		red[width - 1] |= incoming;
+
+		uint64_t wrapping = wrap & ~(red[0] | blue[0]) & live;
+		red[width - 1] &= ~wrapping;
+		red[0] |= wrapping;
+		moved |= wrapping;
+	}
+	return moved;
+}
+
+/* Moves every blue car of the live boards with a white cell below it, rows top to bottom as in
+	bitsolveblueturn. Returns the boards in which a car moved. */
+uint64_t ensemblesolveblueturn(struct ensemble *eg, uint64_t live) {
+	int width = eg->width;
+	int height = eg->height;
+	uint64_t *incoming = eg->scratch;			// Cars that moved down from the previous row
+	uint64_t moved = 0;
+
+	for (int y = 0; y < width; y++) {
+		incoming[y] = 0;
+	}
+	for (int x = 0; x < height - 1; x++) {
+		uint64_t *blue = eg->blue + x * width;
+		uint64_t *belowred = eg->red + (x + 1) * width;
+		uint64_t *belowblue = eg->blue + (x + 1) * width;
+		for (int y = 0; y < width; y++) {
+			uint64_t moving = blue[y] & ~(belowred[y] | belowblue[y]) & live;
+			blue[y] = (blue[y] & ~moving) | incoming[y];
+			incoming[y] = moving;
+			moved |= moving;
+		}
+	}
+
+	uint64_t *lastblue = eg->blue + (height - 1) * width;
+	for (int y = 0; y < width; y++) {
+		uint64_t wrapping = lastblue[y] & ~(eg->red[y] | eg->blue[y]) & live;
+		lastblue[y] = (lastblue[y] & ~wrapping) | incoming[y];
+		eg->blue[y] |= wrapping;
+		moved |= wrapping;
+	}
+	return moved;
+}
+
+/* Adds a word of cars to a bit-sliced counter: plane p holds bit p of each board's count. */
+static void addcount(uint64_t *count, int planes, uint64_t cars) {
+	for (int p = 0; p < planes && cars; p++) {
+		uint64_t carry = count[p] & cars;
+		count[p] ^= cars;
+		cars = carry;
+	}
+}
+
+/* The boards whose count is at least value, comparing from the top plane down. */
+static uint64_t countatleast(uint64_t *count, int planes, int value) {
+	if (value >> planes) {
+		return 0;
+	}
+	uint64_t greater = 0, equal = ~(uint64_t)0;
+	for (int p = planes - 1; p >= 0; p--) {
+		if ((value >> p) & 1) {
+			equal &= count[p];
+		} else {
+			greater |= equal & count[p];
+			equal &= ~count[p];
+		}
+	}
+	return greater | equal;
+}
+
+static int boardcount(uint64_t *count, int planes, int board) {
+	int value = 0;
+	for (int p = 0; p < planes; p++) {
+		value |= (int)((count[p] >> board) & 1) << p;
+	}
+	return value;
+}
+
+/* Counts the red and blue cars in each tile of every live board with bit-sliced counters. Returns the
+	boards with a tile at or over maxcells, and reports the tiles in the format of counttiles. */
+uint64_t ensemblecounttiles(struct ensemble *eg, int tilesize, int tiledimension, int maxcells, uint64_t live) {
+	int tilecols = eg->width / tilesize;
+	int planes = 1;
+	while ((tilesize * tilesize) >> planes) {
+		planes++;
+	}
+	uint64_t *numred = calloc(tilecols * planes, sizeof(uint64_t));
+	uint64_t *numblue = calloc(tilecols * planes, sizeof(uint64_t));
+	uint64_t result = 0;
+
+	for (int x = 0; x < eg->height; x++) {
+		uint64_t *red = eg->red + x * eg->width;
+		uint64_t *blue = eg->blue + x * eg->width;
+		for (int y = 0; y < tilecols * tilesize; y++) {
+			addcount(numred + (y / tilesize) * planes, planes, red[y] & live);
+			addcount(numblue + (y / tilesize) * planes, planes, blue[y] & live);
+		}
+		if ((x + 1) % tilesize == 0) {
+			for (int tile = 0; tile < tilecols; tile++) {
+				uint64_t *tilered = numred + tile * planes;
+				uint64_t *tileblue = numblue + tile * planes;
+				uint64_t over = (countatleast(tilered, planes, maxcells) | countatleast(tileblue, planes, maxcells)) & live;
+				int tilenum = (x / tilesize) * tiledimension + tile;
+				for (uint64_t boards = over; boards; boards &= boards - 1) {
+					int board = __builtin_ctzll(boards);
+					printf("Board %d: Tile %d exceeded max @ red:%d, blue:%d\n", eg->firstboard + board, tilenum,
+						boardcount(tilered, planes, board), boardcount(tileblue, planes, board));
+				}
+				result |= over;
+				for (int p = 0; p < planes; p++) {
+					tilered[p] = tileblue[p] = 0;
+				}
+			}
+		}
+	}
+	free(numred);
+	free(numblue);
+	return result;
+}
@@ -0,0 +1,33 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <stdint.h>
+
+/* Up to 64 independent boards stored bit-sliced: each cell is one red and one blue word, and bit k
+	of every word belongs to board k, so one pass of the move logic advances every board.
+	Boards whose bit is clear in the live mask passed to the turns are left as they are. */
+struct ensemble {
+	int height;
+	int width;
+	int numboards;
+	int firstboard;			// Number of board 0, for the output
+	uint64_t *red;			// Cell (x, y) is word x * width + y
+	uint64_t *blue;
+	uint64_t *scratch;		// One row of words, used by the blue turn
+};
+
+int mallocensemble(struct ensemble *eg, int height, int width, int numboards, int firstboard);
+
+void freeensemble(struct ensemble *eg);
+
+void packensembleboard(struct ensemble *eg, int board, int **grid);
+
+void unpackensembleboard(struct ensemble *eg, int board, int **grid);
+
+uint64_t ensemblesolveredturn(struct ensemble *eg, uint64_t live);
+
+uint64_t ensemblesolveblueturn(struct ensemble *eg, uint64_t live);
+
+uint64_t ensemblecounttiles(struct ensemble *eg, int tilesize, int tiledimension, int maxcells, uint64_t live);
+
+#endif
@@ -0,0 +1,128 @@
+#include "halo.h"
+#include "redblueprocedure.h"
+#include "neighbor.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Sets up the datatypes for a ghost zone of the given depth around a rows x cols interior. */
+int createdeephalo(struct deephalo *dh, int depth, int rows, int cols, int left, int right, int top, int bot, MPI_Comm comm, int collective) {
+	if (depth > rows || depth > cols) {
+		return -1;								// Neighbours can't fill a ghost zone deeper than their subgrid
+	}
+	dh->depth = depth;
+	dh->rows = rows;
+	dh->cols = cols;
+	dh->height = rows + 2 * depth;
+	dh->width = cols + 2 * depth;
+	dh->left = left;
+	dh->right = right;
+	dh->top = top;
+	dh->bot = bot;
+	dh->comm = comm;
+	dh->collective = collective;
+	MPI_Type_vector(rows, depth, dh->width, MPI_INT, &dh->colblock);
+	MPI_Type_commit(&dh->colblock);
+	MPI_Type_contiguous(depth * dh->width, MPI_INT, &dh->rowblock);
+	MPI_Type_commit(&dh->rowblock);
+	return 0;
+}
+
+void freedeephalo(struct deephalo *dh) {
+	MPI_Type_free(&dh->colblock);
+	MPI_Type_free(&dh->rowblock);
+}
+
+/* Refreshes the whole ghost zone. Columns are swapped first, then whole padded rows, so the
+	corners come from the diagonal neighbours by way of the left and right ones. As collectives,
+	both directions of each step go in one call. */
+void exchangedeephalo(struct deephalo *dh, int **grid) {
+	int k = dh->depth;
+	int *base = &grid[0][0];
+	int *row = base + k * dh->width;			// First interior row
+
+	if (dh->collective) {
+		struct neighborexchange ne;
+		initneighborexchange(&ne, dh->comm);
+		setneighborsend(&ne, NEIGHBOR_LEFT, row + k, 1, dh->colblock);
+		setneighborsend(&ne, NEIGHBOR_RIGHT, row + dh->cols, 1, dh->colblock);
+		setneighborrecv(&ne, NEIGHBOR_LEFT, row, 1, dh->colblock);
+		setneighborrecv(&ne, NEIGHBOR_RIGHT, row + k + dh->cols, 1, dh->colblock);
+		runneighborexchange(&ne);
+
+		initneighborexchange(&ne, dh->comm);
+		setneighborsend(&ne, NEIGHBOR_TOP, row, 1, dh->rowblock);
+		setneighborsend(&ne, NEIGHBOR_BOT, base + dh->rows * dh->width, 1, dh->rowblock);
+		setneighborrecv(&ne, NEIGHBOR_TOP, base, 1, dh->rowblock);
+		setneighborrecv(&ne, NEIGHBOR_BOT, base + (k + dh->rows) * dh->width, 1, dh->rowblock);
+		runneighborexchange(&ne);
+		return;
+	}
+	MPI_Sendrecv(row + k, 1, dh->colblock, dh->left, 3, row + k + dh->cols, 1, dh->colblock, dh->right, 3, dh->comm, MPI_STATUS_IGNORE);
+	MPI_Sendrecv(row + dh->cols, 1, dh->colblock, dh->right, 4, row, 1, dh->colblock, dh->left, 4, dh->comm, MPI_STATUS_IGNORE);
+	MPI_Sendrecv(row, 1, dh->rowblock, dh->top, 5, base + (k + dh->rows) * dh->width, 1, dh->rowblock, dh->bot, 5, dh->comm, MPI_STATUS_IGNORE);
+	MPI_Sendrecv(base + dh->rows * dh->width, 1, dh->rowblock, dh->bot, 6, base, 1, dh->rowblock, dh->top, 6, dh->comm, MPI_STATUS_IGNORE);
+}
+
+/* Picks a ghost zone depth that balances message latency against redundant computation.
+	With a latency L per exchange and a cost c per cell, an iteration costs about
+	L / k + c (rows + 2k)(cols + 2k), which is smallest near k = sqrt(L / (2c(rows + cols))).
+	L is timed with depth 1 exchanges and c with a few turns on a copy of the subgrid.
+	All processes agree on the smallest depth. */
+int choosehalodepth(int **localgrid, int rows, int cols, int left, int right, int top, int bot, MPI_Comm comm, int collective) {
+	const int reps = 10;
+	struct deephalo dh;
+	int **scratch;
+	int *blockedrow = malloc((rows + 2) * sizeof(int));
+	int *blockedcol = malloc((cols + 2) * sizeof(int));
+
+	createdeephalo(&dh, 1, rows, cols, left, right, top, bot, comm, collective);
+	malloc2darray(&scratch, dh.height, dh.width);
+	for (int x = 0; x < dh.height; x++) {
+		memset(scratch[x], 0, dh.width * sizeof(int));
+	}
+	for (int x = 0; x < rows; x++) {
+		memcpy(&scratch[x + 1][1], localgrid[x], cols * sizeof(int));
+	}
+
+	MPI_Barrier(comm);
+	double start = MPI_Wtime();
+	for (int i = 0; i < reps; i++) {
+		exchangedeephalo(&dh, scratch);
+	}
+	double latency = (MPI_Wtime() - start) / reps;
+
+	for (int x = 0; x < dh.height; x++) {
+		blockedrow[x] = 1;
+	}
+	for (int y = 0; y < dh.width; y++) {
+		blockedcol[y] = 1;
+	}
+	start = MPI_Wtime();
+	for (int i = 0; i < reps; i++) {
+		solveredturn(scratch, blockedrow, dh.height, dh.width);
+		setemptycells(scratch, dh.height, dh.width, 1);
+		solveblueturn(scratch, blockedcol, dh.height, dh.width);
+		setemptycells(scratch, dh.height, dh.width, 2);
+	}
+	double cellcost = (MPI_Wtime() - start) / reps / (dh.height * dh.width);
+
+	int depth = (int)(sqrt(latency / (2 * cellcost * (rows + cols))) + 0.5);
+	if (depth < 1) {
+		depth = 1;
+	}
+	if (depth > rows) {
+		depth = rows;
+	}
+	if (depth > cols) {
+		depth = cols;
+	}
+	int alldepth;
+	MPI_Allreduce(&depth, &alldepth, 1, MPI_INT, MPI_MIN, comm);
+
+	free2darray(&scratch);
+	freedeephalo(&dh);
+	free(blockedrow);
+	free(blockedcol);
+	return alldepth;
+}
@@ -0,0 +1,29 @@
+#ifndef HALO_H
+#define HALO_H
+
+#include <mpi.h>
+
+/* A subgrid padded with a ghost zone depth cells wide on every side, refreshed from the 4 neighbours
+	every depth iterations. The interior starts at grid[depth][depth]. */
+struct deephalo {
+	int depth;
+	int rows;					// Interior size
+	int cols;
+	int height;					// Padded size
+	int width;
+	int left, right, top, bot;
+	MPI_Comm comm;
+	MPI_Datatype colblock;		// depth columns of the interior rows
+	MPI_Datatype rowblock;		// depth rows of the whole padded width
+	int collective;				// Swap with MPI_Neighbor_alltoallw, comm being the torus communicator
+};
+
+int createdeephalo(struct deephalo *dh, int depth, int rows, int cols, int left, int right, int top, int bot, MPI_Comm comm, int collective);
+
+void freedeephalo(struct deephalo *dh);
+
+void exchangedeephalo(struct deephalo *dh, int **grid);
+
+int choosehalodepth(int **localgrid, int rows, int cols, int left, int right, int top, int bot, MPI_Comm comm, int collective);
+
+#endif
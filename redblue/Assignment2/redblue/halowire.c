@@ -0,0 +1,97 @@
+#include "halowire.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MESSAGE_BITS	0
+#define MESSAGE_DELTA	1
+
+/* Allocates a channel for messages of size cells, starting from an empty last message. */
+int mallochalochannel(struct halochannel *hc, int size, int kind, int format) {
+	int bytes = (size + 7) / 8;
+	hc->size = size;
+	hc->kind = kind;
+	hc->format = format;
+	hc->bits = calloc(bytes, 1);
+	hc->next = calloc(bytes, 1);
+	hc->message = malloc(1 + bytes);
+	if (!hc->bits || !hc->next || !hc->message) {
+		freehalochannel(hc);
+		return -1;
+	}
+	return 0;
+}
+
+void freehalochannel(struct halochannel *hc) {
+	free(hc->bits);
+	free(hc->next);
+	free(hc->message);
+	hc->bits = hc->next = hc->message = NULL;
+}
+
+/* Packs the cells, stride ints apart, into a message. A delta is a list of 32 bit positions, so it
+	is used when fewer than a quarter as many bits as there are bytes changed. Returns the length. */
+static int encodehalo(struct halochannel *hc, int *cells, int stride) {
+	int bytes = (hc->size + 7) / 8;
+	memset(hc->next, 0, bytes);
+	for (int i = 0; i < hc->size; i++) {
+		int cell = cells[i * stride];
+		if (hc->kind == WIRE_OCCUPIED ? cell != 0 : cell == 3) {
+			hc->next[i / 8] |= 1 << (i % 8);
+		}
+	}
+
+	int length = -1;
+	if (hc->format == WIRE_DELTA) {
+		length = 1;
+		for (int b = 0; b < bytes && length != -1; b++) {
+			for (int changed = hc->bits[b] ^ hc->next[b]; changed; changed &= changed - 1) {
+				if (length + 4 > bytes) {
+					length = -1;
+					break;
+				}
+				int32_t position = b * 8 + __builtin_ctz(changed);
+				memcpy(hc->message + length, &position, 4);
+				length += 4;
+			}
+		}
+		hc->message[0] = MESSAGE_DELTA;
+	}
+	if (length == -1) {
+		hc->message[0] = MESSAGE_BITS;
+		memcpy(hc->message + 1, hc->next, bytes);
+		length = 1 + bytes;
+	}
+	memcpy(hc->bits, hc->next, bytes);
+	return length;
+}
+
+/* Applies a received message to the last bits and unpacks them into the cells. */
+static void decodehalo(struct halochannel *hc, int length, int *cells) {
+	int bytes = (hc->size + 7) / 8;
+	if (hc->message[0] == MESSAGE_BITS) {
+		memcpy(hc->bits, hc->message + 1, bytes);
+	} else {
+		for (int offset = 1; offset < length; offset += 4) {
+			int32_t position;
+			memcpy(&position, hc->message + offset, 4);
+			hc->bits[position / 8] ^= 1 << (position % 8);
+		}
+	}
+	int value = hc->kind == WIRE_OCCUPIED ? 1 : 3;
+	for (int i = 0; i < hc->size; i++) {
+		cells[i] = (hc->bits[i / 8] >> (i % 8)) & 1 ? value : 0;
+	}
+}
+
+/* Sends the cells, stride ints apart, to dest and receives the cells from source into recvcells,
+	like MPI_Sendrecv with the cells as MPI_INTs. */
+void sendrecvhalo(struct halochannel *out, int *sendcells, int stride, int dest,
+	struct halochannel *in, int *recvcells, int source, int tag, MPI_Comm comm) {
+	MPI_Status status;
+	int length = encodehalo(out, sendcells, stride);
+	MPI_Sendrecv(out->message, length, MPI_UNSIGNED_CHAR, dest, tag,
+		in->message, 1 + (in->size + 7) / 8, MPI_UNSIGNED_CHAR, source, tag, comm, &status);
+	MPI_Get_count(&status, MPI_UNSIGNED_CHAR, &length);
+	decodehalo(in, length, recvcells);
+}
@@ -0,0 +1,30 @@
+#ifndef HALOWIRE_H
+#define HALOWIRE_H
+
+#include <mpi.h>
+#include "redblueoptions.h"
+
+// What the bit of a cell says. A ghost cell is only ever tested for being empty, and a cell sent back
+// only for holding an arriving car, so one bit is all the receiver needs.
+#define WIRE_OCCUPIED	0		// The cell isn't empty, received as 1
+#define WIRE_ARRIVED	1		// A car moved into the cell, a 3, received as 3
+
+/* One direction of one of the exchanges of an iteration. Both ends keep the bits of the last message,
+	so a delta can be applied to them. The copies stay equal because every message is received. */
+struct halochannel {
+	int size;					// Cells per message
+	int kind;
+	int format;					// WIRE_BITS or WIRE_DELTA
+	unsigned char *bits;		// Bits of the last message
+	unsigned char *next;		// Bits being sent
+	unsigned char *message;		// A format byte, then the bits or the positions that changed
+};
+
+int mallochalochannel(struct halochannel *hc, int size, int kind, int format);
+
+void freehalochannel(struct halochannel *hc);
+
+void sendrecvhalo(struct halochannel *out, int *sendcells, int stride, int dest,
+	struct halochannel *in, int *recvcells, int source, int tag, MPI_Comm comm);
+
+#endif
@@ -0,0 +1,77 @@
+#include "lagcheck.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Allocates the checks for a rows x cols subgrid, the first of them for the given iteration. */
+int malloclagcheck(struct lagcheck *lc, int lag, int rows, int cols, int iteration, MPI_Comm comm) {
+	lc->lag = lag;
+	lc->rows = rows;
+	lc->cols = cols;
+	lc->saved = malloc((size_t)(lag + 1) * rows * cols * sizeof(int));
+	lc->local = malloc((lag + 1) * sizeof(int));
+	lc->global = malloc((lag + 1) * sizeof(int));
+	lc->requests = malloc((lag + 1) * sizeof(MPI_Request));
+	lc->first = lc->next = iteration;
+	lc->comm = comm;
+	if (!lc->saved || !lc->local || !lc->global || !lc->requests) {
+		freelagcheck(lc);
+		return -1;
+	}
+	return 0;
+}
+
+void freelagcheck(struct lagcheck *lc) {
+	free(lc->saved);
+	free(lc->local);
+	free(lc->global);
+	free(lc->requests);
+	lc->saved = NULL;
+	lc->local = lc->global = NULL;
+	lc->requests = NULL;
+}
+
+/* Waits for the oldest unfinished reduction. Returns its iteration if it was over the threshold,
+	otherwise -1. */
+static int finisholdest(struct lagcheck *lc) {
+	int slot = lc->first % (lc->lag + 1);
+	int iteration = lc->first++;
+	MPI_Wait(&lc->requests[slot], MPI_STATUS_IGNORE);
+	return lc->global[slot] == -1 ? iteration : -1;
+}
+
+/* Waits for every unfinished reduction. Returns the first iteration over the threshold, or -1. */
+int finishlagchecks(struct lagcheck *lc) {
+	int failed = -1;
+	while (lc->first < lc->next) {
+		int result = finisholdest(lc);
+		if (failed == -1) {
+			failed = result;
+		}
+	}
+	return failed;
+}
+
+/* Keeps the grid as it is after the half-turns of the next iteration, and starts the reduction of
+	its tile result. When that leaves more than lag reductions unfinished, waits for the oldest; if it
+	was over the threshold, finishes the rest and returns its iteration. Otherwise returns -1. */
+int startlagcheck(struct lagcheck *lc, int **grid, int tileresult) {
+	int slot = lc->next % (lc->lag + 1);
+	memcpy(lc->saved + (size_t)slot * lc->rows * lc->cols, &grid[0][0], (size_t)lc->rows * lc->cols * sizeof(int));
+	lc->local[slot] = tileresult;
+	MPI_Iallreduce(&lc->local[slot], &lc->global[slot], 1, MPI_INT, MPI_MIN, lc->comm, &lc->requests[slot]);
+	lc->next++;
+	if (lc->next - lc->first > lc->lag) {
+		int failed = finisholdest(lc);
+		if (failed != -1) {
+			finishlagchecks(lc);
+			return failed;
+		}
+	}
+	return -1;
+}
+
+/* Copies the kept subgrid of an iteration whose reduction has finished back into grid. */
+void restorelagcheck(struct lagcheck *lc, int **grid, int iteration) {
+	int slot = iteration % (lc->lag + 1);
+	memcpy(&grid[0][0], lc->saved + (size_t)slot * lc->rows * lc->cols, (size_t)lc->rows * lc->cols * sizeof(int));
+}
@@ -0,0 +1,33 @@
+#ifndef LAGCHECK_H
+#define LAGCHECK_H
+
+#include <mpi.h>
+
+/* Threshold checks reduced with MPI_Iallreduce while the next lag iterations run. The subgrid after
+	each unconfirmed iteration is kept, so a run can go back to the first iteration that turns out to
+	be over the threshold. Every process waits at the same points, so they all start and finish the
+	same reductions. */
+struct lagcheck {
+	int lag;
+	int rows;
+	int cols;
+	int *saved;					// lag + 1 subgrids, iteration i in slot i % (lag + 1)
+	int *local;					// Each slot's tile result and its reduction
+	int *global;
+	MPI_Request *requests;
+	int first;					// Oldest iteration whose reduction is unfinished
+	int next;					// Iteration after the last one started
+	MPI_Comm comm;
+};
+
+int malloclagcheck(struct lagcheck *lc, int lag, int rows, int cols, int iteration, MPI_Comm comm);
+
+void freelagcheck(struct lagcheck *lc);
+
+int startlagcheck(struct lagcheck *lc, int **grid, int tileresult);
+
+int finishlagchecks(struct lagcheck *lc);
+
+void restorelagcheck(struct lagcheck *lc, int **grid, int iteration);
+
+#endif
@@ -0,0 +1,30 @@
+#include "neighbor.h"
+
+/* Sets up an exchange that sends and receives nothing. */
+void initneighborexchange(struct neighborexchange *ne, MPI_Comm cartcomm) {
+	ne->comm = cartcomm;
+	for (int i = 0; i < 4; i++) {
+		ne->sendcounts[i] = ne->recvcounts[i] = 0;
+		ne->senddispls[i] = ne->recvdispls[i] = 0;
+		ne->sendtypes[i] = ne->recvtypes[i] = MPI_INT;
+	}
+}
+
+/* Sets the block sent to one neighbour. Called again whenever the buffer moves, as it does when
+	ping-pong stepping swaps the grids. */
+void setneighborsend(struct neighborexchange *ne, int neighbor, void *buffer, int count, MPI_Datatype type) {
+	MPI_Get_address(buffer, &ne->senddispls[neighbor]);
+	ne->sendcounts[neighbor] = count;
+	ne->sendtypes[neighbor] = type;
+}
+
+void setneighborrecv(struct neighborexchange *ne, int neighbor, void *buffer, int count, MPI_Datatype type) {
+	MPI_Get_address(buffer, &ne->recvdispls[neighbor]);
+	ne->recvcounts[neighbor] = count;
+	ne->recvtypes[neighbor] = type;
+}
+
+void runneighborexchange(struct neighborexchange *ne) {
+	MPI_Neighbor_alltoallw(MPI_BOTTOM, ne->sendcounts, ne->senddispls, ne->sendtypes,
+		MPI_BOTTOM, ne->recvcounts, ne->recvdispls, ne->recvtypes, ne->comm);
+}
@@ -0,0 +1,34 @@
+#ifndef NEIGHBOR_H
+#define NEIGHBOR_H
+
+#include <mpi.h>
+
+// Neighbours of a process on the 2D torus, in the order MPI_Neighbor_alltoallw uses for a
+// Cartesian communicator: the lower then the higher neighbour of each dimension
+#define NEIGHBOR_TOP	0
+#define NEIGHBOR_BOT	1
+#define NEIGHBOR_LEFT	2
+#define NEIGHBOR_RIGHT	3
+
+/* One halo exchange as a single MPI_Neighbor_alltoallw on the torus communicator, so the library
+	can run all of its transfers at once. Blocks are given by absolute address from MPI_BOTTOM, so
+	they can live in different buffers, and a neighbour with no block has a count of 0. */
+struct neighborexchange {
+	MPI_Comm comm;
+	int sendcounts[4];
+	int recvcounts[4];
+	MPI_Aint senddispls[4];
+	MPI_Aint recvdispls[4];
+	MPI_Datatype sendtypes[4];
+	MPI_Datatype recvtypes[4];
+};
+
+void initneighborexchange(struct neighborexchange *ne, MPI_Comm cartcomm);
+
+void setneighborsend(struct neighborexchange *ne, int neighbor, void *buffer, int count, MPI_Datatype type);
+
+void setneighborrecv(struct neighborexchange *ne, int neighbor, void *buffer, int count, MPI_Datatype type);
+
+void runneighborexchange(struct neighborexchange *ne);
+
+#endif
@@ -0,0 +1,472 @@
+#include "quadtree.h"
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Mixes a 64-bit value (splitmix64), for the node and window table keys. */
+static uint64_t mix(uint64_t z) {
+	z += 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static struct qtnode *newnode(size_t cells) {
+	struct qtnode *node = malloc(sizeof(struct qtnode) + cells);
+	if (!node) {
+		printf("Could not allocate quadtree node\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	node->result = NULL;
+	node->maxred = node->maxblue = 0;
+	node->seamcol = node->seamrow = 0;
+	return node;
+}
+
+/* Links a new node into its bucket, doubling the table once there are more nodes than buckets. */
+static struct qtnode *addnode(struct quadtree *qt, struct qtnode *node) {
+	if (qt->numnodes >= qt->numbuckets) {
+		size_t numbuckets = qt->numbuckets * 2;
+		struct qtnode **buckets = calloc(numbuckets, sizeof(struct qtnode *));
+		if (!buckets) {
+			printf("Could not allocate quadtree table\n");
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		for (size_t b = 0; b < qt->numbuckets; b++) {
+			struct qtnode *old = qt->buckets[b];
+			while (old) {
+				struct qtnode *next = old->next;
+				old->next = buckets[old->key & (numbuckets - 1)];
+				buckets[old->key & (numbuckets - 1)] = old;
+				old = next;
+			}
+		}
+		free(qt->buckets);
+		qt->buckets = buckets;
+		qt->numbuckets = numbuckets;
+	}
+	size_t b = node->key & (qt->numbuckets - 1);
+	node->next = qt->buckets[b];
+	qt->buckets[b] = node;
+	qt->numnodes++;
+	return node;
+}
+
+/* Returns the leaf for a tile of cells, read with the given row stride, making it if it's new. */
+static struct qtnode *makeleaf(struct quadtree *qt, const unsigned char *cells, int stride, int seamcol, int seamrow) {
+	int t = qt->tilesize;
+	uint64_t key = 0xcbf29ce484222325ULL;
+	for (int x = 0; x < t; x++) {
+		for (int y = 0; y < t; y++) {
+			key = (key ^ cells[x * stride + y]) * 0x100000001b3ULL;
+		}
+	}
+	key = mix(key ^ (seamcol | seamrow << 1));
+
+	for (struct qtnode *node = qt->buckets[key & (qt->numbuckets - 1)]; node; node = node->next) {
+		if (node->key != key || node->level != 0 || node->seamcol != seamcol || node->seamrow != seamrow) {
+			continue;
+		}
+		int same = 1;
+		for (int x = 0; x < t && same; x++) {
+			same = memcmp(node->cells + x * t, cells + x * stride, t) == 0;
+		}
+		if (same) {
+			return node;
+		}
+	}
+
+	struct qtnode *node = newnode(t * t);
+	for (int x = 0; x < t; x++) {
+		memcpy(node->cells + x * t, cells + x * stride, t);
+	}
+	node->child[0] = node->child[1] = node->child[2] = node->child[3] = NULL;
+	node->key = key;
+	node->level = 0;
+	node->seamcol = seamcol;
+	node->seamrow = seamrow;
+	return addnode(qt, node);
+}
+
+/* Returns the node with the given quadrants, making it if it's new. */
+static struct qtnode *join(struct quadtree *qt, struct qtnode *nw, struct qtnode *ne, struct qtnode *sw, struct qtnode *se) {
+	uint64_t key = mix((uintptr_t)nw ^ mix((uintptr_t)ne ^ mix((uintptr_t)sw ^ mix((uintptr_t)se))));
+	for (struct qtnode *node = qt->buckets[key & (qt->numbuckets - 1)]; node; node = node->next) {
+		if (node->key == key && node->child[0] == nw && node->child[1] == ne && node->child[2] == sw && node->child[3] == se) {
+			return node;
+		}
+	}
+	struct qtnode *node = newnode(0);
+	node->child[0] = nw;
+	node->child[1] = ne;
+	node->child[2] = sw;
+	node->child[3] = se;
+	node->key = key;
+	node->level = nw->level + 1;
+	return addnode(qt, node);
+}
+
+/* Returns the leaf at tile (row, col) of a node. */
+static struct qtnode *tileat(struct qtnode *node, int row, int col) {
+	for (int level = node->level; level > 0; level--) {
+		int half = 1 << (level - 1);
+		node = node->child[(row >= half) * 2 + (col >= half)];
+		row %= half;
+		col %= half;
+	}
+	return node;
+}
+
+/* Whether the car at position i of a line moves one cell along it. Past the ends of the line counts as full.
+	At the seam the single process turns wrap against the new state of column (or row) 0, which is also
+	free if the car there moves on, so a car there looks two cells ahead. */
+static int carmoves(const unsigned char *line, int stride, const unsigned char *seam, int i, int size, int color) {
+	if (line[i * stride] != color || i + 1 >= size) {
+		return 0;
+	}
+	unsigned char ahead = line[(i + 1) * stride];
+	if (ahead == 0) {
+		return 1;
+	}
+	return seam[i] && ahead == color && i + 2 < size && line[(i + 2) * stride] == 0;
+}
+
+/* Half-turn for one row (stride 1) or column (stride of a row) of the base case board. */
+static void stepline(const unsigned char *old, unsigned char *new, int stride, const unsigned char *seam, int size, int color) {
+	int arriving = 0;
+	for (int i = 0; i < size; i++) {
+		int leaving = carmoves(old, stride, seam, i, size, color);
+		new[i * stride] = arriving ? color : (leaving ? 0 : old[i * stride]);
+		arriving = leaving;
+	}
+}
+
+/* Base case for a level 3 node (8 x 8 tiles): solves tilesize iterations cell by cell.
+	The cells that are right shrink by at most 2 cells per iteration from each edge (the seam reads 2 ahead),
+	so the centre 4 x 4 tiles are right throughout and are the ones counted. */
+static void solvebase(struct quadtree *qt, struct qtnode *node) {
+	int t = qt->tilesize;
+	int size = 8 * t;
+	unsigned char *cur = qt->cur;
+	unsigned char *next = qt->next;
+	for (int i = 0; i < 8; i++) {
+		for (int j = 0; j < 8; j++) {
+			struct qtnode *leaf = tileat(node, i, j);
+			for (int x = 0; x < t; x++) {
+				memcpy(cur + (i * t + x) * size + j * t, leaf->cells + x * t, t);
+			}
+		}
+	}
+	for (int k = 0; k < size; k++) {
+		qt->seamcols[k] = k % t == t - 1 && tileat(node, 0, k / t)->seamcol;
+		qt->seamrows[k] = k % t == t - 1 && tileat(node, k / t, 0)->seamrow;
+	}
+
+	int maxred = 0, maxblue = 0;
+	for (int iter = 0; iter < t; iter++) {
+		for (int x = 0; x < size; x++) {
+			stepline(cur + x * size, next + x * size, 1, qt->seamcols, size, 1);
+		}
+		for (int y = 0; y < size; y++) {
+			stepline(next + y, cur + y, size, qt->seamrows, size, 2);
+		}
+		for (int i = 2; i < 6; i++) {
+			for (int j = 2; j < 6; j++) {
+				int numred = 0, numblue = 0;
+				for (int x = i * t; x < (i + 1) * t; x++) {
+					for (int y = j * t; y < (j + 1) * t; y++) {
+						numred += cur[x * size + y] == 1;
+						numblue += cur[x * size + y] == 2;
+					}
+				}
+				maxred = numred > maxred ? numred : maxred;
+				maxblue = numblue > maxblue ? numblue : maxblue;
+			}
+		}
+	}
+
+	struct qtnode *centre[16];
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			struct qtnode *leaf = tileat(node, i + 2, j + 2);
+			centre[i * 4 + j] = makeleaf(qt, cur + (i + 2) * t * size + (j + 2) * t, size, leaf->seamcol, leaf->seamrow);
+		}
+	}
+	node->result = join(qt,
+		join(qt, centre[0], centre[1], centre[4], centre[5]),
+		join(qt, centre[2], centre[3], centre[6], centre[7]),
+		join(qt, centre[8], centre[9], centre[12], centre[13]),
+		join(qt, centre[10], centre[11], centre[14], centre[15]));
+	node->maxred = maxred;
+	node->maxblue = maxblue;
+}
+
+/* Works out the centre of a node at level k >= 3 after tilesize * 2^(k-3) iterations, as in Hashlife:
+	nine overlapping subnodes are each advanced half way, then regrouped into four and advanced again.
+	The tile maxima are taken over every part solved, which all lie inside the node and are counted at
+	iterations inside the jump, so a threshold reached anywhere in the centre is never missed. */
+static struct qtnode *solvenode(struct quadtree *qt, struct qtnode *node) {
+	if (node->result) {
+		return node->result;
+	}
+	if (node->level == 3) {
+		solvebase(qt, node);
+		return node->result;
+	}
+
+	struct qtnode *nw = node->child[0], *ne = node->child[1], *sw = node->child[2], *se = node->child[3];
+	struct qtnode *parts[9] = {
+		nw,
+		join(qt, nw->child[1], ne->child[0], nw->child[3], ne->child[2]),
+		ne,
+		join(qt, nw->child[2], nw->child[3], sw->child[0], sw->child[1]),
+		join(qt, nw->child[3], ne->child[2], sw->child[1], se->child[0]),
+		join(qt, ne->child[2], ne->child[3], se->child[0], se->child[1]),
+		sw,
+		join(qt, sw->child[1], se->child[0], sw->child[3], se->child[2]),
+		se
+	};
+
+	int maxred = 0, maxblue = 0;
+	struct qtnode *halfway[9];
+	for (int i = 0; i < 9; i++) {
+		halfway[i] = solvenode(qt, parts[i]);
+		maxred = parts[i]->maxred > maxred ? parts[i]->maxred : maxred;
+		maxblue = parts[i]->maxblue > maxblue ? parts[i]->maxblue : maxblue;
+	}
+
+	struct qtnode *quarters[4];
+	for (int i = 0; i < 4; i++) {
+		int k = (i / 2) * 3 + i % 2;
+		struct qtnode *part = join(qt, halfway[k], halfway[k + 1], halfway[k + 3], halfway[k + 4]);
+		quarters[i] = solvenode(qt, part);
+		maxred = part->maxred > maxred ? part->maxred : maxred;
+		maxblue = part->maxblue > maxblue ? part->maxblue : maxblue;
+	}
+
+	node->result = join(qt, quarters[0], quarters[1], quarters[2], quarters[3]);
+	node->maxred = maxred;
+	node->maxblue = maxblue;
+	return node->result;
+}
+
+/* Returns the node at the given level whose top left tile is board tile (row, col), repeating the board
+	in both directions. Each level only has as many different nodes as there are tiles, so they are
+	built once each, however large the window is. */
+static struct qtnode *buildwindow(struct quadtree *qt, int level, int row, int col) {
+	if (level == 0) {
+		return qt->leaves[row * qt->tiles + col];
+	}
+	size_t mask = qt->windowsize - 1;
+	size_t slot = mix(((uint64_t)level << 48) ^ ((uint64_t)row << 24) ^ col) & mask;
+	for (; qt->window[slot].node; slot = (slot + 1) & mask) {
+		if (qt->window[slot].level == level && qt->window[slot].row == row && qt->window[slot].col == col) {
+			return qt->window[slot].node;
+		}
+	}
+
+	int half = (1LL << (level - 1)) % qt->tiles;
+	int row2 = (row + half) % qt->tiles;
+	int col2 = (col + half) % qt->tiles;
+	struct qtnode *node = join(qt, buildwindow(qt, level - 1, row, col), buildwindow(qt, level - 1, row, col2),
+		buildwindow(qt, level - 1, row2, col), buildwindow(qt, level - 1, row2, col2));
+
+	if (2 * (qt->windowcount + 1) > qt->windowsize) {		// Keep the table at most half full
+		struct qtwindow *old = qt->window;
+		size_t oldsize = qt->windowsize;
+		qt->windowsize *= 2;
+		qt->window = calloc(qt->windowsize, sizeof(struct qtwindow));
+		if (!qt->window) {
+			printf("Could not allocate quadtree window\n");
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		qt->windowcount = 0;
+		for (size_t i = 0; i < oldsize; i++) {
+			if (old[i].node) {
+				size_t s = mix(((uint64_t)old[i].level << 48) ^ ((uint64_t)old[i].row << 24) ^ old[i].col) & (qt->windowsize - 1);
+				while (qt->window[s].node) {
+					s = (s + 1) & (qt->windowsize - 1);
+				}
+				qt->window[s] = old[i];
+				qt->windowcount++;
+			}
+		}
+		free(old);
+		mask = qt->windowsize - 1;
+		slot = mix(((uint64_t)level << 48) ^ ((uint64_t)row << 24) ^ col) & mask;
+		while (qt->window[slot].node) {
+			slot = (slot + 1) & mask;
+		}
+	}
+	qt->window[slot].level = level;
+	qt->window[slot].row = row;
+	qt->window[slot].col = col;
+	qt->window[slot].node = node;
+	qt->windowcount++;
+	return node;
+}
+
+/* Copies the tiles of node that fall on the board, with the node's top left at board tile (row, col). */
+static void extractleaves(struct quadtree *qt, struct qtnode *node, long long row, long long col) {
+	if (row >= qt->tiles || col >= qt->tiles) {
+		return;
+	}
+	if (node->level == 0) {
+		qt->leaves[row * qt->tiles + col] = node;
+		return;
+	}
+	long long half = 1LL << (node->level - 1);
+	extractleaves(qt, node->child[0], row, col);
+	extractleaves(qt, node->child[1], row, col + half);
+	extractleaves(qt, node->child[2], row + half, col);
+	extractleaves(qt, node->child[3], row + half, col + half);
+}
+
+/* Makes the leaves from qt->cells. */
+static void loadleaves(struct quadtree *qt) {
+	int t = qt->tilesize;
+	for (int i = 0; i < qt->tiles; i++) {
+		for (int j = 0; j < qt->tiles; j++) {
+			qt->leaves[i * qt->tiles + j] = makeleaf(qt, qt->cells + i * t * qt->n + j * t, qt->n,
+				j == qt->tiles - 1, i == qt->tiles - 1);
+		}
+	}
+}
+
+/* Copies the leaves into qt->cells. */
+static void storeleaves(struct quadtree *qt) {
+	int t = qt->tilesize;
+	for (int i = 0; i < qt->tiles; i++) {
+		for (int j = 0; j < qt->tiles; j++) {
+			struct qtnode *leaf = qt->leaves[i * qt->tiles + j];
+			for (int x = 0; x < t; x++) {
+				memcpy(qt->cells + (i * t + x) * qt->n + j * t, leaf->cells + x * t, t);
+			}
+		}
+	}
+}
+
+static void freenodes(struct quadtree *qt) {
+	for (size_t b = 0; b < qt->numbuckets; b++) {
+		struct qtnode *node = qt->buckets[b];
+		while (node) {
+			struct qtnode *next = node->next;
+			free(node);
+			node = next;
+		}
+		qt->buckets[b] = NULL;
+	}
+	qt->numnodes = 0;
+}
+
+/* Allocates an empty quadtree for an n x n board. n must be a multiple of the tile size. */
+int mallocquadtree(struct quadtree *qt, int n, int tilesize) {
+	int base = 8 * tilesize;
+	qt->n = n;
+	qt->tilesize = tilesize;
+	qt->tiles = n / tilesize;
+	qt->numbuckets = 1 << 16;
+	qt->numnodes = 0;
+	qt->windowsize = 1 << 10;
+	qt->windowcount = 0;
+	qt->buckets = calloc(qt->numbuckets, sizeof(struct qtnode *));
+	qt->leaves = malloc(qt->tiles * qt->tiles * sizeof(struct qtnode *));
+	qt->cells = malloc((size_t)n * n);
+	qt->cur = malloc(2 * base * base);
+	qt->next = qt->cur ? qt->cur + base * base : NULL;
+	qt->seamcols = malloc(2 * base);
+	qt->seamrows = qt->seamcols ? qt->seamcols + base : NULL;
+	qt->window = calloc(qt->windowsize, sizeof(struct qtwindow));
+	if (!qt->buckets || !qt->leaves || !qt->cells || !qt->cur || !qt->seamcols || !qt->window) {
+		freequadtree(qt);
+		return -1;
+	}
+	return 0;
+}
+
+void freequadtree(struct quadtree *qt) {
+	if (qt->buckets) {
+		freenodes(qt);
+	}
+	free(qt->buckets);
+	free(qt->leaves);
+	free(qt->cells);
+	free(qt->cur);
+	free(qt->seamcols);
+	free(qt->window);
+	qt->buckets = qt->leaves = NULL;
+	qt->cells = qt->cur = qt->next = qt->seamcols = qt->seamrows = NULL;
+	qt->window = NULL;
+}
+
+void packquadtree(struct quadtree *qt, int **grid) {
+	for (int x = 0; x < qt->n; x++) {
+		for (int y = 0; y < qt->n; y++) {
+			qt->cells[x * qt->n + y] = grid[x][y];
+		}
+	}
+	loadleaves(qt);
+}
+
+void unpackquadtree(struct quadtree *qt, int **grid) {
+	storeleaves(qt);
+	for (int x = 0; x < qt->n; x++) {
+		for (int y = 0; y < qt->n; y++) {
+			grid[x][y] = qt->cells[x * qt->n + y];
+		}
+	}
+}
+
+/* Iterations a window at the given level jumps. */
+static long long stepsat(struct quadtree *qt, int level) {
+	return (long long)qt->tilesize << (level - 3);
+}
+
+/* Advances the board by up to maxiters iterations in jumps of tilesize * 2^(k-3), doubling the jump
+	after each one that succeeds. A jump is only kept if no tile reached maxcells during it, and the
+	iterations it could not finish this way are left for the caller to solve turn by turn,
+	so the threshold is still found on the iteration it is reached. Returns the iterations advanced. */
+int quadtreeadvance(struct quadtree *qt, int maxiters, int maxcells) {
+	int minlevel = 3;
+	while ((1LL << (minlevel - 1)) < qt->tiles) {		// The centre of the window must cover the board
+		minlevel++;
+	}
+	int level = minlevel;
+	int maxlevel = 62;
+	long long done = 0;
+
+	while (1) {
+		while (level > minlevel && (level > maxlevel || stepsat(qt, level) > maxiters - done)) {
+			level--;
+		}
+		if (stepsat(qt, level) > maxiters - done) {
+			break;
+		}
+
+		// The window repeats the board, placed so its centre starts at board tile (0, 0)
+		int offset = (1LL << (level - 2)) % qt->tiles;
+		memset(qt->window, 0, qt->windowsize * sizeof(struct qtwindow));
+		qt->windowcount = 0;
+		struct qtnode *root = buildwindow(qt, level, (qt->tiles - offset) % qt->tiles, (qt->tiles - offset) % qt->tiles);
+		struct qtnode *result = solvenode(qt, root);
+
+		if (root->maxred >= maxcells || root->maxblue >= maxcells) {
+			if (level == minlevel) {
+				break;
+			}
+			maxlevel = --level;					// Don't grow back into the jump that failed
+			continue;
+		}
+		extractleaves(qt, result, 0, 0);
+		done += stepsat(qt, level);
+		level++;
+
+		if (qt->numnodes > QUADTREE_MAXNODES) {	// Start the tables again from just the board
+			storeleaves(qt);
+			freenodes(qt);
+			loadleaves(qt);
+		}
+	}
+	return done;
+}
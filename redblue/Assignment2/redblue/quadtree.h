@@ -0,0 +1,61 @@
+#ifndef QUADTREE_H
+#define QUADTREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define QUADTREE_MAXNODES	(1 << 22)	// Nodes kept before the tables are cleared between jumps
+
+/* Node of a hash-consed quadtree. A leaf (level 0) holds one tile of cells, and a node at level k
+	holds 2^k x 2^k tiles. Equal subtrees are stored once, so each node can memoize its own future:
+	its centre after tilesize * 2^(k-3) iterations, and the most red and blue cars any tile held meanwhile. */
+struct qtnode {
+	struct qtnode *child[4];		// nw, ne, sw, se, or NULL for a leaf
+	struct qtnode *result;			// Memoized centre, NULL until worked out
+	struct qtnode *next;			// Next node in the same hash bucket
+	uint64_t key;
+	int level;
+	int maxred;						// Most cars of each color in a tile over the steps of result
+	int maxblue;
+	unsigned char seamcol;			// Leaf holds the last column / row of the board, where the turns wrap
+	unsigned char seamrow;
+	unsigned char cells[];			// Leaf cells, tilesize x tilesize
+};
+
+struct qtwindow {
+	int level;
+	int row;
+	int col;
+	struct qtnode *node;
+};
+
+/* A board of n x n cells as tiles x tiles leaves, plus the tables shared by every jump. */
+struct quadtree {
+	int n;
+	int tilesize;
+	int tiles;						// Tiles per side of the board
+	struct qtnode **buckets;
+	size_t numbuckets;
+	size_t numnodes;
+	struct qtnode **leaves;			// Current board, row by row
+	unsigned char *cells;			// n x n cells, used when packing and clearing
+	unsigned char *cur;				// Two (8 * tilesize)^2 boards for the brute force base case
+	unsigned char *next;
+	unsigned char *seamcols;		// Which base case columns / rows are the last of the board
+	unsigned char *seamrows;
+	struct qtwindow *window;		// Nodes built for the current window, by level and board position
+	size_t windowsize;
+	size_t windowcount;
+};
+
+int mallocquadtree(struct quadtree *qt, int n, int tilesize);
+
+void freequadtree(struct quadtree *qt);
+
+void packquadtree(struct quadtree *qt, int **grid);
+
+void unpackquadtree(struct quadtree *qt, int **grid);
+
+int quadtreeadvance(struct quadtree *qt, int maxiters, int maxcells);
+
+#endif
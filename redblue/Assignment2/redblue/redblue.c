@@ -1,39 +1,97 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <mpi.h>
 #include <time.h>
 #include "debuggrid.h"
 #include <math.h>
 #include <time.h>
 #include "redblueprocedure.h"
+#include "redblueoptions.h"
+#include "bitgrid.h"
+#include "bytegrid.h"
+#include "tilecount.h"
+#include "activity.h"
+#include "halo.h"
+#include "boardhash.h"
+#include "quadtree.h"
+#include "threadpool.h"
+#include "tilesched.h"
+#include "ensemble.h"
+#include "sweep.h"
+#include "rng.h"
+#include "boardio.h"
+#include "snapshot.h"
+#include "neighbor.h"
+#include "halowire.h"
+#include "lagcheck.h"
+#include "balance.h"
 
-void board_init(int** grid, int size);
-int malloc2darray(int ***array, int x, int y);
-void setemptycells(int **subgrid, int height, int width, int intcolor); 
 void setemptybuffercells(int *buf, int size, int color);
-int free2darray(int ***array);
-void updatetoprow(int *toprow, int *tempbuffer,  int size);
-void updateleftrow(int **localgrid, int *tempcol, int height);
+void swapgrids(int ***a, int ***b);
+void solverowhalfturn(int ***grid, int ***nextgrid, int *rightbuffer, int height, int width, int color, int stepping, struct tilecounts *counts, struct activity *act, struct threadpool *pool, struct tilescheduler *sched);
+void solvecolumnhalfturn(int ***grid, int ***nextgrid, int *botbuffer, int height, int width, int stepping, struct tilecounts *counts, struct activity *act, struct threadpool *pool, struct tilescheduler *sched);
+void overlappedrowturn(int **grid, int height, int width, int color, int *sendcol, int *ghostcol, int *arrivals, int left, int right, int tag, struct tilecounts *counts, MPI_Comm comm);
+void overlappedcolumnturn(int **grid, int height, int width, int *sendrow, int *ghostrow, int *arrivals, int top, int bot, int tag, struct tilecounts *counts, MPI_Comm comm);
+int solvedeephalo(int **localgrid, int rows, int cols, int depth, int left, int right, int top, int bot, MPI_Comm comm,
+	struct options *opts, int toprowindex, int leftcolindex, int tilesize, int tiledimension, int numtiles, int maxcells, int curriter, int maxiters, struct threadpool *pool, struct snapshotwriter *snap);
+int restartsubgrid(struct options *opts, int **grid, int rows, int cols, int toprow, int leftcol, int n, MPI_Comm comm);
+int checkpointdue(struct options *opts, int iteration);
+void savecheckpoint(struct options *opts, int **grid, int rows, int cols, int toprow, int leftcol, int n, int t, int iteration, MPI_Comm comm);
+struct snapshotwriter *startsnapshots(struct options *opts, struct snapshotwriter *sw, int rank, int rows, int cols, int toprow, int leftcol, int n, int t);
+void stopsnapshots(struct options *opts, struct snapshotwriter *sw, int rank);
+int skipcycles(int curriter, int period, int maxiters, int rank);
+void markarrivals(int *ghost, int *edge, int stride, int size, int color);
+int rollbacklagcheck(struct lagcheck *lc, int iteration, int **grid, int rows, int cols, struct tilecounts *counts, int maxcells);
 int counttiles(int **localgrid, int height, int width, int toprowindex, int leftcolindex, int tilesize, int tiledimension, int numtiles, int maxcells);
 void get2dprocdimensions(int *xdim, int *ydim, int worldsize);
+void printsubgrids(int **localgrid, int rows, int cols, int leftcolindex, int n, int t, MPI_Comm cartcomm);
 
 int main(char argc, char** argv) {
-	if ((argc + 0) != 5) {	
+	struct options opts;
+	if ((argc + 0) < 5) {	
 		printf("Required arguments missing");
 		return -1;
 	}
+	if (parseoptions(&opts, argc, argv) == -1) {
+		return -1;
+	}
 
-	MPI_Init(NULL, NULL);
+	// Only the main thread makes MPI calls, the pool threads just run the kernels
+	int provided;
+	MPI_Init_thread(NULL, NULL, MPI_THREAD_FUNNELED, &provided);
 	int rank, worldsize;
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 	MPI_Comm_size(MPI_COMM_WORLD, &worldsize);	
 
+	struct threadpool pool, *poolp = NULL;
+	if (opts.threads > 1) {
+		if (provided < MPI_THREAD_FUNNELED) {
+			printf("MPI library does not support MPI_THREAD_FUNNELED\n");
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		if (createthreadpool(&pool, opts.threads) == -1) {
+			printf("Could not start %d threads\n", opts.threads);
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		poolp = &pool;
+	}
+
+	// A sweep reads lists of values from the required arguments and does its own runs
+	if (opts.sweepfile) {
+		if (runsweep(&opts, argv) == -1) {
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		MPI_Finalize();
+		return 0;
+	}
+
 	int n 				= strtol(argv[1], NULL, 10);	// Grid size
 	int t 				= strtol(argv[2], NULL, 10);	// Tile size
 	float  c 			= atof(argv[3]);				// Terminating threshold
 	int maxiters 		= strtol(argv[4], NULL, 10);	// Max iterations
 	int curriter 		= 0;							// Current iteration
-	int **grid;											// Master grid
+	int **grid;											// Whole board, for the runs on one process
 	int **localgrid;									// For storing local grids
 	int numtoexceedc	= (int)(t * t * c + 1);			// Cells to exceed the threshold
 	int tiledimension 	= n / t;						// Tiles in each dimension
@@ -41,17 +99,109 @@ int main(char argc, char** argv) {
 	clock_t start, end;
 	double elapsed;	
 	
-	malloc2darray(&grid, n, n);
+	// The board only depends on the seed, so every process has to use process 0's
+	if (opts.seed == -1) {
+		opts.seed = time(NULL);
+		MPI_Bcast(&opts.seed, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+	}
+	struct boardrng rng;
+	initboardrng(&rng, opts.seed, 0, opts.red, opts.blue);
+	
+	if ((opts.outputfile || opts.checkpointfile) && n % t != 0) {
+		if (rank == 0) {
+			printf("-output and -checkpoint store whole tiles, so the grid size must be a multiple of the tile size\n");
+		}
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	if (opts.engine == ENGINE_QUADTREE && n % t != 0) {
+		if (rank == 0) {
+			printf("The quadtree's leaves are whole tiles, so the grid size must be a multiple of the tile size\n");
+		}
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
 	
 	if (rank == 0) {
 		printf("Initializing board of size %d with tile size %d, threshold %f and max iterations %d, num to exceed %d \n", n, t, c, maxiters, numtoexceedc);
-		board_init(grid, n);		
-		print_grid(grid, n, n);
+		if (!opts.restartfile) {
+			printf("Seed %lld, red density %f, blue density %f\n", opts.seed, opts.red, opts.blue);
+		}
+	}
+	if (rank == 0 && !opts.outputfile && !opts.restartfile) {
+		// Made a row at a time, so no process has to hold the whole board when it is split up
+		int *row = malloc(n * sizeof(int));
+		for (int x = 0; x < n; x++) {
+			fillboard(&rng, &row, 1, n, x, 0);
+			print_array(row, n);
+		}
+		free(row);
 	}
 	
 	start = clock();
-	// If we need to use multiple processes
-	if (worldsize > 1 && t != n) {
+	if (opts.boards > 1) {
+		// Every process runs its own boards, numbered from rank * boards. Board b is stream b of the
+		// seed, so board 0 is the one printed above.
+		struct ensemble eg;
+		if (malloc2darray(&grid, n, n) == -1 || mallocensemble(&eg, n, n, opts.boards, rank * opts.boards) == -1) {
+			printf("Could not allocate %d boards\n", opts.boards);
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		for (int board = 0; board < opts.boards; board++) {
+			initboardrng(&rng, opts.seed, rank * opts.boards + board, opts.red, opts.blue);
+			fillboard(&rng, grid, n, n, 0, 0);
+			packensembleboard(&eg, board, grid);
+		}
+
+		// Boards leave the live mask when a tile exceeds the threshold, or when nothing moved in an
+		// iteration, since then the board never changes again
+		uint64_t live = opts.boards == 64 ? ~(uint64_t)0 : ((uint64_t)1 << opts.boards) - 1;
+		uint64_t exceeded = 0, jammed = 0;
+		int *stopiter = malloc(opts.boards * sizeof(int));
+		while (live && curriter < maxiters) {
+			uint64_t moved = ensemblesolveredturn(&eg, live);
+			moved |= ensemblesolveblueturn(&eg, live);
+			uint64_t over = ensemblecounttiles(&eg, t, tiledimension, numtoexceedc, live);
+			for (uint64_t boards = over; boards; boards &= boards - 1) {
+				stopiter[__builtin_ctzll(boards)] = curriter;
+			}
+			exceeded |= over;
+			live &= ~over;
+			curriter++;
+			uint64_t stuck = live & ~moved;
+			for (uint64_t boards = stuck; boards; boards &= boards - 1) {
+				stopiter[__builtin_ctzll(boards)] = curriter;
+			}
+			jammed |= stuck;
+			live &= ~stuck;
+		}
+		for (uint64_t boards = live; boards; boards &= boards - 1) {
+			stopiter[__builtin_ctzll(boards)] = curriter;
+		}
+
+		for (int board = 0; board < opts.boards; board++) {
+			int number = rank * opts.boards + board;
+			unpackensembleboard(&eg, board, grid);
+			printf("Final grid for board %d\n============ \n", number);
+			print_grid(grid, n, n);
+			if ((exceeded >> board) & 1) {
+				printf("Board %d exceeded the threshold after %d iterations\n", number, stopiter[board]);
+			} else if ((jammed >> board) & 1) {
+				printf("Board %d jammed after %d iterations\n", number, stopiter[board]);
+			} else {
+				printf("Board %d ran all %d iterations\n", number, stopiter[board]);
+			}
+		}
+		printf("Process %d: %d of %d boards jammed, %d exceeded the threshold\n", rank,
+			__builtin_popcountll(jammed), opts.boards, __builtin_popcountll(exceeded));
+		free(stopiter);
+		freeensemble(&eg);
+	} else if (worldsize > 1 && t != n) {
+		// If we need to use multiple processes
+		if (opts.engine != ENGINE_DEFAULT && opts.engine != ENGINE_INT) {
+			if (rank == 0) {
+				printf("The bit, simd and quadtree engines only run on one process, the split board uses the int engine\n");
+			}
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
 		int mynumrows, mynumcols, rowtilesremainder, coltilesremainder;
 
 		// Max number of processes in each dimension
@@ -113,132 +263,431 @@ int main(char argc, char** argv) {
 		int coltilesperproc			= tiledimension / cartcols;			// How many tiles per proc in x dimension?
 		int rowtilesperproc			= tiledimension / cartrows;
 
-		int rowprocswithextratiles 	= rowtilesremainder % cartcols;		// How many processes get extra row tiles?
-		int colprocswithextratiles 	= coltilesremainder % cartrows;		// How many extra column tiles?
+		int rowprocswithextratiles 	= rowtilesremainder;			// How many processes get an extra row of tiles?
+		int colprocswithextratiles 	= coltilesremainder;			// How many an extra column of tiles?
 		int rowsperproc				= rowtilesperproc * t;			// Translate tiles into row counts
 		int colsperproc				= coltilesperproc * t;
 
 		// Assign the rows for this process
 		if (mycoordx < rowprocswithextratiles) {
-			mynumrows = rowsperproc * 2;
+			mynumrows = rowsperproc + t;
 		} else {
 			mynumrows = rowsperproc;
 		}
 
 		// Assign the columns for this process
 		if (mycoordy < colprocswithextratiles) {
-			mynumcols = colsperproc * 2;
+			mynumcols = colsperproc + t;
 		} else {
 			mynumcols = colsperproc;
 		}
 
-		malloc2darray(&localgrid, mynumrows, mynumcols);
-		if (grank == 0) {
-			for (int x = 0; x < mynumrows; x++) {
-				for (int y = 0; y < mynumcols; y++) {
-					localgrid[x][y] = grid[x][y];
-				}
-			}			
-			int dest = -1;
-			int xdest = 0, ydest = 0, sendcols = 0;
-			int counter = 0;
-			int colproc = 0, rowproc = 0;
-			int destcoords[2];
-
-			for (int x = 0; x < n; x++) {				//Send rows from master to worker processes
-				for (int y = 0; y < n;) {
-					int tilecolindex = y / t;			// Get the index of this tile columnwise
-					int tilerowindex = x / t;			
+		// Get the index of the top row and leftmost column in the subgrid, after the extra tiles of the processes before.
+		int toprowindex = mycoordx * rowsperproc + (mycoordx < rowprocswithextratiles ? mycoordx : rowprocswithextratiles) * t;
+		int leftcolindex = mycoordy * colsperproc + (mycoordy < colprocswithextratiles ? mycoordy : colprocswithextratiles) * t;
 
-					if (y < mynumcols * colprocswithextratiles) {
-						colproc = y / mynumcols;
-						sendcols = mynumcols;
-					} else {
-						colproc = (y - (mynumcols * colprocswithextratiles)) / colsperproc;
-						colproc += colprocswithextratiles;
-						sendcols = colsperproc;
-					}
-					if (tilerowindex < rowprocswithextratiles) {
-						rowproc = tilerowindex * t / mynumrows;
-					} 
-					else {
-						rowproc = (tilerowindex * t - (mynumrows * rowprocswithextratiles)) / rowsperproc;
-						rowproc += rowprocswithextratiles;
-					}	
-
-					destcoords[0] = rowproc;
-					destcoords[1] = colproc;
-					MPI_Cart_rank(cartcomm, destcoords, &dest);
-
-					// If the destination is the master process - skip, as it already has its own subgrid.
-					if (dest == 0) {
-						y += sendcols;
-						continue;
-					}
-					MPI_Send(&grid[x][y], sendcols, MPI_INT, dest, 0, activecomm);
-					y += sendcols;
-				}
-			}
+		// Each process makes its own cells, which are the same as the rows printed by process 0
+		if (malloc2darray(&localgrid, mynumrows, mynumcols) == -1) {
+			printf("Could not allocate the %d x %d subgrid of process %d\n", mynumrows, mynumcols, rank);
+			MPI_Abort(MPI_COMM_WORLD, 1);
 		}
-		else {
-			for (int x = 0; x < mynumrows; x++) {
-				MPI_Recv(&localgrid[x][0], mynumcols, MPI_INT, 0, 0, activecomm, MPI_STATUS_IGNORE); 
-			}
+		if (opts.restartfile) {
+			curriter = restartsubgrid(&opts, localgrid, mynumrows, mynumcols, toprowindex, leftcolindex, n, activecomm);
+		} else if (poolp) {
+			threadedfillboard(poolp, &rng, localgrid, mynumrows, mynumcols, toprowindex, leftcolindex);
+		} else {
+			fillboard(&rng, localgrid, mynumrows, mynumcols, toprowindex, leftcolindex);
 		}
+		struct snapshotwriter snap;
+		struct snapshotwriter *snapp = startsnapshots(&opts, &snap, grank, mynumrows, mynumcols, toprowindex, leftcolindex, n, t);
 
-		// For storing columns into rows for red turn
-		int* rightcolbuffer = malloc (mynumrows * sizeof (int));
-		int* templeftbuffer = malloc (mynumrows * sizeof (int));
-		int* leftcolrow = malloc (mynumrows * sizeof (int));
-		for (int i = 0; i < mynumrows; i++) {
-			leftcolrow[i] = localgrid[i][0];
-		} 
-		
-		int* tempbotbuffer =  malloc (mynumcols * sizeof (int));
-		int* botbuffer =  malloc (mynumcols * sizeof (int)); 
-		int src, dest;	
 		int right, left, top, bot;
 
 		// Get 4 neighbour processes
 		MPI_Cart_shift(cartcomm, 1, 1, &left, &right);
 		MPI_Cart_shift(cartcomm, 0, 1, &top, &bot);
+
+		if (opts.cycles && (opts.stepping != STEP_ACTIVE || opts.halodepth != 0)) {
+			if (grank == 0) {
+				printf("Cycle detection needs -step active and the 1 cell halo exchange\n");
+			}
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+
+		if (opts.halodepth != 0) {
+			int depth = opts.halodepth;
+			if (depth < 0) {
+				depth = choosehalodepth(localgrid, mynumrows, mynumcols, left, right, top, bot, cartcomm, opts.exchange == EXCHANGE_NEIGHBOR);
+				if (grank == 0) {
+					printf("Using ghost zone depth %d\n", depth);
+				}
+			}
+			curriter = solvedeephalo(localgrid, mynumrows, mynumcols, depth, left, right, top, bot, cartcomm, &opts,
+				toprowindex, leftcolindex, t, tiledimension, numtiles, numtoexceedc, curriter, maxiters, poolp, snapp);
+		} else {
+			// Tile bounds of the subgrids, moved by rebalancing
+			int *rowbounds = malloc((cartrows + 1) * sizeof(int)), *newrowbounds = malloc((cartrows + 1) * sizeof(int));
+			int *colbounds = malloc((cartcols + 1) * sizeof(int)), *newcolbounds = malloc((cartcols + 1) * sizeof(int));
+			for (int i = 0; i <= cartrows; i++) {
+				rowbounds[i] = i * rowtilesperproc + (i < rowprocswithextratiles ? i : rowprocswithextratiles);
+			}
+			for (int j = 0; j <= cartcols; j++) {
+				colbounds[j] = j * coltilesperproc + (j < colprocswithextratiles ? j : colprocswithextratiles);
+			}
+			double computetime = 0;					// Time in the kernels and tile checks since the last load balance check
+			int rebalanced;
+			do {
+				rebalanced = 0;
+				// For storing columns into rows for red turn
+				int* rightcolbuffer = malloc (mynumrows * sizeof (int));
+				int* templeftbuffer = malloc (mynumrows * sizeof (int));
+				int* leftcolrow = malloc (mynumrows * sizeof (int));
 		
-		while (curriter < maxiters) {	
-			// Red turn, receive ghost column  on the right (as a row), solve for subgrid, set empty cells
-			MPI_Sendrecv(leftcolrow, mynumrows, MPI_INT, left, 0, rightcolbuffer, mynumrows, MPI_INT, right, 0, activecomm, MPI_STATUS_IGNORE);
-			solveredturn(localgrid, rightcolbuffer, mynumrows, mynumcols);
-			MPI_Sendrecv(rightcolbuffer, mynumrows, MPI_INT, right, 0, templeftbuffer, mynumrows, MPI_INT, left, 0, activecomm, MPI_STATUS_IGNORE);
-			updateleftrow(localgrid, templeftbuffer, mynumrows);
-			setemptycells(localgrid, mynumrows, mynumcols,  1);
-			setemptybuffercells(rightcolbuffer, mynumrows, 1);
+				int* tempbotbuffer =  malloc (mynumcols * sizeof (int));
+				int* botbuffer =  malloc (mynumcols * sizeof (int)); 
+				int* toprowcopy = malloc (mynumcols * sizeof (int));		// Top row being sent up, for overlapped exchanges
+				// Second grid for ping-pong stepping, and the transposed grids for the dual layout
+				int **nextgrid = NULL, **localgridT = NULL, **nextgridT = NULL;
+				if (opts.stepping == STEP_PINGPONG) {
+					malloc2darray(&nextgrid, mynumrows, mynumcols);
+				}
+				if (opts.layout == LAYOUT_DUAL) {
+					malloc2darray(&localgridT, mynumcols, mynumrows);
+					if (opts.stepping == STEP_PINGPONG) {
+						malloc2darray(&nextgridT, mynumcols, mynumrows);
+					}
+				}
+
+				// Per-tile counts, updated as cars cross tile edges
+				struct tilecounts counts, *countsp = NULL;
+				if (opts.tilecount == TILES_INCREMENTAL) {
+					malloctilecounts(&counts, mynumrows, mynumcols, t, toprowindex, leftcolindex, tiledimension);
+					filltilecounts(&counts, localgrid, mynumrows, mynumcols);
+					countsp = &counts;
+				}
+
+				// Regions of the subgrid that may still have moves
+				struct activity act, *actp = NULL;
+				if (opts.stepping == STEP_ACTIVE) {
+					mallocactivity(&act, mynumrows, mynumcols, t);
+					actp = &act;
+				}
+
+				// Tile tasks for the threads when ping-pong stepping
+				struct tilescheduler sched, *schedp = NULL;
+				if (poolp && opts.schedule == SCHED_STEAL) {
+					malloctilescheduler(&sched, poolp, mynumrows, mynumcols, t);
+					schedp = &sched;
+				}
+
+				// Board hash for finding repeated boards, kept up to date by the active kernels
+				struct boardhash hash;
+				struct cycledetector detector;
+				MPI_Op iterationop;
+				uint64_t boardhash = 0;
+				int detecting = opts.cycles;
+				if (opts.cycles) {
+					initboardhash(&hash, toprowindex, leftcolindex, n);
+					fillboardhash(&hash, localgrid, mynumrows, mynumcols);
+					act.hash = &hash;
+					mallocdetector(&detector, mynumrows * mynumcols * sizeof(int));
+					createiterationop(&iterationop);
+				}
+
+				// The exchanges of an iteration as neighbourhood collectives on the torus. The blocks
+				// sent from the grid are set each turn, since ping-pong stepping swaps it.
+				struct neighborexchange redout, redback, blueout, blueback, redsingle, bluesingle;
+				MPI_Datatype edgecol;
+				if (opts.exchange == EXCHANGE_NEIGHBOR || opts.exchange == EXCHANGE_SINGLE) {
+					MPI_Type_vector(mynumrows, 1, mynumcols, MPI_INT, &edgecol);
+					MPI_Type_commit(&edgecol);
+				}
+				if (opts.exchange == EXCHANGE_NEIGHBOR) {
+					initneighborexchange(&redout, cartcomm);
+					setneighborrecv(&redout, NEIGHBOR_RIGHT, rightcolbuffer, mynumrows, MPI_INT);
+					initneighborexchange(&redback, cartcomm);
+					setneighborsend(&redback, NEIGHBOR_RIGHT, rightcolbuffer, mynumrows, MPI_INT);
+					setneighborrecv(&redback, NEIGHBOR_LEFT, templeftbuffer, mynumrows, MPI_INT);
+					initneighborexchange(&blueout, cartcomm);
+					setneighborrecv(&blueout, NEIGHBOR_BOT, botbuffer, mynumcols, MPI_INT);
+					initneighborexchange(&blueback, cartcomm);
+					setneighborsend(&blueback, NEIGHBOR_BOT, botbuffer, mynumcols, MPI_INT);
+					setneighborrecv(&blueback, NEIGHBOR_TOP, tempbotbuffer, mynumcols, MPI_INT);
+				}
+				if (opts.exchange == EXCHANGE_SINGLE) {
+					// The neighbours' edges arrive in the buffers the return trip would have filled
+					initneighborexchange(&redsingle, cartcomm);
+					setneighborrecv(&redsingle, NEIGHBOR_RIGHT, rightcolbuffer, mynumrows, MPI_INT);
+					setneighborrecv(&redsingle, NEIGHBOR_LEFT, templeftbuffer, mynumrows, MPI_INT);
+					initneighborexchange(&bluesingle, cartcomm);
+					setneighborrecv(&bluesingle, NEIGHBOR_BOT, botbuffer, mynumcols, MPI_INT);
+					setneighborrecv(&bluesingle, NEIGHBOR_TOP, tempbotbuffer, mynumcols, MPI_INT);
+				}
+
+				// Compressed halos: the red turn's ghost column and arrivals, then the blue turn's ghost row and arrivals
+				struct halochannel wireout[4], wirein[4];
+				if (opts.wire != WIRE_INT) {
+					int sizes[4] = { mynumrows, mynumrows, mynumcols, mynumcols };
+					for (int i = 0; i < 4; i++) {
+						int kind = i % 2 == 0 ? WIRE_OCCUPIED : WIRE_ARRIVED;
+						mallochalochannel(&wireout[i], sizes[i], kind, opts.wire);
+						mallochalochannel(&wirein[i], sizes[i], kind, opts.wire);
+					}
+				}
+
+				// Threshold checks finished lag iterations late
+				struct lagcheck lagc, *lagp = NULL;
+				if (opts.lag > 0) {
+					malloclagcheck(&lagc, opts.lag, mynumrows, mynumcols, curriter, activecomm);
+					lagp = &lagc;
+				}
+
+				while (curriter < maxiters) {	
+					// Red turn, receive ghost column  on the right (as a row), solve for subgrid, set empty cells.
+					// The left column is copied each turn so the neighbour sees its current state.
+					if (opts.exchange == EXCHANGE_OVERLAP) {
+						overlappedrowturn(localgrid, mynumrows, mynumcols, 1, leftcolrow, rightcolbuffer, templeftbuffer, left, right, 0, countsp, activecomm);
+					} else {
+						if (opts.exchange == EXCHANGE_NEIGHBOR) {
+							setneighborsend(&redout, NEIGHBOR_LEFT, &localgrid[0][0], 1, edgecol);
+							runneighborexchange(&redout);
+						} else if (opts.exchange == EXCHANGE_SINGLE) {
+							setneighborsend(&redsingle, NEIGHBOR_LEFT, &localgrid[0][0], 1, edgecol);
+							setneighborsend(&redsingle, NEIGHBOR_RIGHT, &localgrid[0][mynumcols - 1], 1, edgecol);
+							runneighborexchange(&redsingle);
+							markarrivals(templeftbuffer, &localgrid[0][0], mynumcols, mynumrows, 1);
+						} else if (opts.wire != WIRE_INT) {
+							sendrecvhalo(&wireout[0], &localgrid[0][0], mynumcols, left, &wirein[0], rightcolbuffer, right, 0, activecomm);
+						} else {
+							for (int i = 0; i < mynumrows; i++) {
+								leftcolrow[i] = localgrid[i][0];
+							}
+							MPI_Sendrecv(leftcolrow, mynumrows, MPI_INT, left, 0, rightcolbuffer, mynumrows, MPI_INT, right, 0, activecomm, MPI_STATUS_IGNORE);
+						}
+						double kernelstart = MPI_Wtime();
+						solverowhalfturn(&localgrid, &nextgrid, rightcolbuffer, mynumrows, mynumcols, 1, opts.stepping, countsp, actp, poolp, schedp);
+						computetime += MPI_Wtime() - kernelstart;
+						if (opts.exchange == EXCHANGE_NEIGHBOR) {
+							runneighborexchange(&redback);
+						} else if (opts.wire != WIRE_INT) {
+							sendrecvhalo(&wireout[1], rightcolbuffer, 1, right, &wirein[1], templeftbuffer, left, 0, activecomm);
+						} else if (opts.exchange != EXCHANGE_SINGLE) {
+							MPI_Sendrecv(rightcolbuffer, mynumrows, MPI_INT, right, 0, templeftbuffer, mynumrows, MPI_INT, left, 0, activecomm, MPI_STATUS_IGNORE);
+						}
+					}
+					updateleftrow(localgrid, templeftbuffer, mynumrows);
+					if (countsp) {
+						countbuffercrossings(countsp, templeftbuffer, mynumrows, 1);
+					}
+					if (actp) {
+						wakebuffer(actp, templeftbuffer, mynumrows, 1);
+					}
+					if (opts.stepping == STEP_MARKER) {
+						setemptybuffercells(rightcolbuffer, mynumrows, 1);
+					}
 			
-			// Blue turn, receive ghost row for the bottom, solve subgrid, set empty cells
-			MPI_Sendrecv(&localgrid[0][0], mynumcols, MPI_INT, top, 1, botbuffer, mynumcols, MPI_INT, bot, 1, activecomm, MPI_STATUS_IGNORE);
-			solveblueturn(localgrid, botbuffer, mynumrows, mynumcols);
-			MPI_Sendrecv(botbuffer, mynumcols, MPI_INT, bot, 2, tempbotbuffer, mynumcols, MPI_INT, top, 2, activecomm, MPI_STATUS_IGNORE);
-			updatetoprow(&localgrid[0][0], tempbotbuffer,  mynumcols);
-			setemptycells(localgrid, mynumrows, mynumcols, 2);
-			setemptybuffercells(botbuffer, mynumcols, 2);
+					// Blue turn, receive ghost row for the bottom, solve subgrid, set empty cells.
+					// In the dual layout the blue turn is a red-style turn on the transposed subgrid.
+					if (opts.exchange == EXCHANGE_OVERLAP && opts.layout == LAYOUT_DUAL) {
+						transposegrid(localgrid, localgridT, mynumrows, mynumcols);
+						overlappedrowturn(localgridT, mynumcols, mynumrows, 2, toprowcopy, botbuffer, tempbotbuffer, top, bot, 1, countsp, activecomm);
+						transposegrid(localgridT, localgrid, mynumcols, mynumrows);
+					} else if (opts.exchange == EXCHANGE_OVERLAP) {
+						overlappedcolumnturn(localgrid, mynumrows, mynumcols, toprowcopy, botbuffer, tempbotbuffer, top, bot, 1, countsp, activecomm);
+					} else {
+						if (opts.exchange == EXCHANGE_NEIGHBOR) {
+							setneighborsend(&blueout, NEIGHBOR_TOP, localgrid[0], mynumcols, MPI_INT);
+							runneighborexchange(&blueout);
+						} else if (opts.exchange == EXCHANGE_SINGLE) {
+							setneighborsend(&bluesingle, NEIGHBOR_TOP, localgrid[0], mynumcols, MPI_INT);
+							setneighborsend(&bluesingle, NEIGHBOR_BOT, localgrid[mynumrows - 1], mynumcols, MPI_INT);
+							runneighborexchange(&bluesingle);
+							markarrivals(tempbotbuffer, localgrid[0], 1, mynumcols, 2);
+						} else if (opts.wire != WIRE_INT) {
+							sendrecvhalo(&wireout[2], localgrid[0], 1, top, &wirein[2], botbuffer, bot, 1, activecomm);
+						} else {
+							MPI_Sendrecv(&localgrid[0][0], mynumcols, MPI_INT, top, 1, botbuffer, mynumcols, MPI_INT, bot, 1, activecomm, MPI_STATUS_IGNORE);
+						}
+						double kernelstart = MPI_Wtime();
+						if (opts.layout == LAYOUT_DUAL) {
+							transposegrid(localgrid, localgridT, mynumrows, mynumcols);
+							solverowhalfturn(&localgridT, &nextgridT, botbuffer, mynumcols, mynumrows, 2, opts.stepping, countsp, actp, poolp, schedp);
+							transposegrid(localgridT, localgrid, mynumcols, mynumrows);
+						} else {
+							solvecolumnhalfturn(&localgrid, &nextgrid, botbuffer, mynumrows, mynumcols, opts.stepping, countsp, actp, poolp, schedp);
+						}
+						computetime += MPI_Wtime() - kernelstart;
+						if (opts.exchange == EXCHANGE_NEIGHBOR) {
+							runneighborexchange(&blueback);
+						} else if (opts.wire != WIRE_INT) {
+							sendrecvhalo(&wireout[3], botbuffer, 1, bot, &wirein[3], tempbotbuffer, top, 2, activecomm);
+						} else if (opts.exchange != EXCHANGE_SINGLE) {
+							MPI_Sendrecv(botbuffer, mynumcols, MPI_INT, bot, 2, tempbotbuffer, mynumcols, MPI_INT, top, 2, activecomm, MPI_STATUS_IGNORE);
+						}
+					}
+					updatetoprow(&localgrid[0][0], tempbotbuffer,  mynumcols);
+					if (countsp) {
+						countbuffercrossings(countsp, tempbotbuffer, mynumcols, 2);
+					}
+					if (actp) {
+						wakebuffer(actp, tempbotbuffer, mynumcols, 2);
+					}
+					if (opts.stepping == STEP_MARKER) {
+						setemptybuffercells(botbuffer, mynumcols, 2);
+					}
 			
-			// Now check if tiles exceed c. If not, proceed with the next iteration.
-			int tileresult 		= 0;
-			int toprowindex 	= -1;				// The index in the whole grid of the top local row
-			int leftcolindex	= -1;
-			int allresult 		= 0;
-
-			// Get the index of the top row and leftmost column in the subgrid.
-			toprowindex = (mycoordx + rowprocswithextratiles) * rowsperproc;
-			leftcolindex = (mycoordy + colprocswithextratiles) * colsperproc;
-			tileresult = counttiles(localgrid, mynumrows, mynumcols, toprowindex, leftcolindex, t, tiledimension, numtiles, numtoexceedc);
-			MPI_Allreduce(&tileresult, &allresult, 1, MPI_INT, MPI_MIN, activecomm);
-			if (allresult == -1) {
-				break;
+					// Now check if tiles exceed c. If not, proceed with the next iteration.
+					int tileresult 		= 0;
+					int allresult 		= 0;
+
+					double countstart = MPI_Wtime();
+					if (countsp && lagp) {
+						tileresult = tilecountsover(countsp, numtoexceedc);		// Reported if it turns out to be the last iteration
+					} else if (countsp) {
+						tileresult = checktilecounts(countsp, numtoexceedc);
+					} else if (poolp) {
+						tileresult = threadedcounttiles(poolp, localgrid, mynumrows, mynumcols, toprowindex, leftcolindex, t, tiledimension, numtoexceedc);
+					} else {
+						tileresult = counttiles(localgrid, mynumrows, mynumcols, toprowindex, leftcolindex, t, tiledimension, numtiles, numtoexceedc);
+					}
+					computetime += MPI_Wtime() - countstart;
+					if (opts.cycles) {
+						// One reduction gives both the tile result and the hash of the whole board
+						uint64_t local[2] = { tileresult == -1, hash.hash };
+						uint64_t all[2];
+						MPI_Allreduce(local, all, 2, MPI_UINT64_T, iterationop, activecomm);
+						allresult = all[0] ? -1 : 0;
+						boardhash = all[1];
+					} else if (lagp) {
+						int failed = startlagcheck(lagp, localgrid, tileresult);
+						if (failed != -1) {
+							curriter = rollbacklagcheck(lagp, failed, localgrid, mynumrows, mynumcols, countsp, numtoexceedc);
+							break;
+						}
+					} else {
+						MPI_Allreduce(&tileresult, &allresult, 1, MPI_INT, MPI_MIN, activecomm);
+					}
+					if (allresult == -1) {
+						break;
+					}
+					curriter++;
+					if (detecting) {
+						int period = checkcycle(&detector, boardhash, curriter, &localgrid[0][0], activecomm);
+						if (period > 0) {
+							curriter = skipcycles(curriter, period, maxiters, grank);
+							detecting = 0;
+						}
+					}
+					int snapshotdue = snapp && curriter % opts.snapshotevery == 0;
+					int rebalancedue = opts.rebalanceevery > 0 && curriter % opts.rebalanceevery == 0 && curriter < maxiters;
+					if (lagp && (checkpointdue(&opts, curriter) || snapshotdue || rebalancedue)) {
+						// Only iterations every check has passed are written or rebalanced
+						int failed = finishlagchecks(lagp);
+						if (failed != -1) {
+							curriter = rollbacklagcheck(lagp, failed, localgrid, mynumrows, mynumcols, countsp, numtoexceedc);
+							break;
+						}
+					}
+					if (checkpointdue(&opts, curriter)) {
+						savecheckpoint(&opts, localgrid, mynumrows, mynumcols, toprowindex, leftcolindex, n, t, curriter, activecomm);
+					}
+					if (snapshotdue) {
+						takesnapshot(snapp, localgrid, curriter);
+					}
+					if (rebalancedue) {
+						memcpy(newrowbounds, rowbounds, (cartrows + 1) * sizeof(int));
+						memcpy(newcolbounds, colbounds, (cartcols + 1) * sizeof(int));
+						rebalanced = measurebounds(newrowbounds, newcolbounds, computetime, tiledimension, cartcomm);
+						computetime = 0;
+						if (rebalanced) {
+							break;
+						}
+					}
+				}
+				if (lagp) {
+					int failed = finishlagchecks(lagp);
+					if (failed != -1) {
+						curriter = rollbacklagcheck(lagp, failed, localgrid, mynumrows, mynumcols, countsp, numtoexceedc);
+					}
+					freelagcheck(lagp);
+				}
+				if (opts.cycles) {
+					freedetector(&detector);
+					MPI_Op_free(&iterationop);
+				}
+				if (schedp) {
+					freetilescheduler(schedp);
+				}
+				if (opts.exchange == EXCHANGE_NEIGHBOR || opts.exchange == EXCHANGE_SINGLE) {
+					MPI_Type_free(&edgecol);
+				}
+				if (opts.wire != WIRE_INT) {
+					for (int i = 0; i < 4; i++) {
+						freehalochannel(&wireout[i]);
+						freehalochannel(&wirein[i]);
+					}
+				}
+				if (countsp) {
+					freetilecounts(countsp);
+				}
+				if (actp) {
+					freeactivity(actp);
+				}
+				if (nextgrid) {
+					free2darray(&nextgrid);
+				}
+				if (localgridT) {
+					free2darray(&localgridT);
+				}
+				if (nextgridT) {
+					free2darray(&nextgridT);
+				}
+				free(rightcolbuffer);
+				free(templeftbuffer);
+				free(leftcolrow);
+				free(tempbotbuffer);
+				free(botbuffer);
+				free(toprowcopy);
+
+				// Move the cells to the new bounds and start again on the new subgrids
+				if (rebalanced) {
+					if (redistributesubgrid(&localgrid, rowbounds, colbounds, newrowbounds, newcolbounds, t, cartcomm) == -1) {
+						printf("Could not allocate the new subgrid of process %d\n", rank);
+						MPI_Abort(MPI_COMM_WORLD, 1);
+					}
+					memcpy(rowbounds, newrowbounds, (cartrows + 1) * sizeof(int));
+					memcpy(colbounds, newcolbounds, (cartcols + 1) * sizeof(int));
+					toprowindex = rowbounds[mycoordx] * t;
+					leftcolindex = colbounds[mycoordy] * t;
+					mynumrows = (rowbounds[mycoordx + 1] - rowbounds[mycoordx]) * t;
+					mynumcols = (colbounds[mycoordy + 1] - colbounds[mycoordy]) * t;
+					if (grank == 0) {
+						printf("Rebalanced the subgrids after %d iterations\n", curriter);
+					}
+				}
+			} while (rebalanced);
+			free(rowbounds);
+			free(newrowbounds);
+			free(colbounds);
+			free(newcolbounds);
+		}
+		stopsnapshots(&opts, snapp, grank);
+		if (opts.outputfile) {
+			if (writeboardfile(opts.outputfile, localgrid, mynumrows, mynumcols, toprowindex, leftcolindex, n, t, curriter, opts.seed, cartcomm) == -1) {
+				if (grank == 0) {
+					printf("Could not write %s\n", opts.outputfile);
+				}
+				MPI_Abort(MPI_COMM_WORLD, 1);
 			}
-			curriter++;
+			if (grank == 0) {
+				printf("Final grid written to %s after %d iterations\n", opts.outputfile, curriter);
+			}
+		} else {
+			if (grank == 0) {
+				printf("Final grid \n============ \n");
+			}
+			printsubgrids(localgrid, mynumrows, mynumcols, leftcolindex, n, t, cartcomm);
 		}
-		printf("Grid for process %d\n", rank);
-		print_grid(localgrid, mynumrows, mynumcols);
-		printf("\n");
 	}
 	else
 	{
@@ -246,25 +695,292 @@ int main(char argc, char** argv) {
 			MPI_Finalize();
 			exit(0);
 		}
-		while (curriter < maxiters) {
-			solveredturn(grid, NULL, n, n);
-			setemptycells(grid, n, n, 1);
-			solveblueturn(grid, NULL, n, n);
-			setemptycells(grid, n, n, 2);
-			if (counttiles(grid, n, n, 0, 0, t, tiledimension, numtiles, numtoexceedc) == -1) {
-				break;
+		if (opts.halodepth != 0 || opts.exchange != EXCHANGE_BLOCKING || opts.wire != WIRE_INT || opts.lag > 0 || opts.rebalanceevery > 0) {
+			printf("-halo, -exchange, -wire, -lag and -rebalance only apply when the board is split between processes\n");
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		// No int engine option was given, so take the fastest engine
+		if (opts.engine == ENGINE_DEFAULT) {
+			opts.engine = ENGINE_BIT;
+		}
+		if (malloc2darray(&grid, n, n) == -1) {
+			printf("Could not allocate the grid\n");
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		if (opts.restartfile) {
+			curriter = restartsubgrid(&opts, grid, n, n, 0, 0, n, MPI_COMM_SELF);
+		} else if (poolp) {
+			threadedfillboard(poolp, &rng, grid, n, n, 0, 0);
+		} else {
+			fillboard(&rng, grid, n, n, 0, 0);
+		}
+		struct snapshotwriter snap;
+		struct snapshotwriter *snapp = startsnapshots(&opts, &snap, 0, n, n, 0, 0, n, t);
+		if (opts.engine == ENGINE_BIT) {
+			struct bitgrid bg;
+			if (mallocbitgrid(&bg, n, n) == -1) {
+				printf("Could not allocate bit planes\n");
+				MPI_Abort(MPI_COMM_WORLD, 1);
+			}
+			packbitgrid(&bg, grid);
+
+			struct boardhash hash;
+			struct cycledetector detector;
+			int detecting = opts.cycles;
+			if (opts.cycles) {
+				initboardhash(&hash, 0, 0, n);
+				bg.hash = &hash;
+				fillbitgridhash(&bg);
+				mallocdetector(&detector, 2 * n * bg.words * sizeof(uint64_t));
+			}
+			while (curriter < maxiters) {
+				bitsolveredturn(&bg);
+				bitsolveblueturn(&bg);
+				if (bitcounttiles(&bg, t, tiledimension, numtoexceedc) == -1) {
+					break;
+				}
+				curriter++;
+				if (detecting) {
+					int period = checkcycle(&detector, hash.hash, curriter, bg.red, MPI_COMM_SELF);
+					if (period > 0) {
+						curriter = skipcycles(curriter, period, maxiters, rank);
+						detecting = 0;
+					}
+				}
+				if (checkpointdue(&opts, curriter) || (snapp && curriter % opts.snapshotevery == 0)) {
+					unpackbitgrid(&bg, grid);
+				}
+				if (checkpointdue(&opts, curriter)) {
+					savecheckpoint(&opts, grid, n, n, 0, 0, n, t, curriter, MPI_COMM_SELF);
+				}
+				if (snapp && curriter % opts.snapshotevery == 0) {
+					takesnapshot(snapp, grid, curriter);
+				}
+			}
+			if (opts.cycles) {
+				freedetector(&detector);
+			}
+			unpackbitgrid(&bg, grid);
+			freebitgrid(&bg);
+		} else if (opts.cycles && (opts.engine != ENGINE_INT || opts.stepping != STEP_ACTIVE)) {
+			printf("Cycle detection needs the bit engine, or the int engine with -step active\n");
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		} else if (opts.engine == ENGINE_SIMD) {
+			struct bytegrid bg;
+			if (mallocbytegrid(&bg, n, n) == -1) {
+				printf("Could not allocate byte grid\n");
+				MPI_Abort(MPI_COMM_WORLD, 1);
+			}
+			printf("Using %s byte kernels\n", bytegridisa());
+			packbytegrid(&bg, grid);
+			while (curriter < maxiters) {
+				bytesolveredturn(&bg);
+				bytesolveblueturn(&bg);
+				if (bytecounttiles(&bg, t, tiledimension, numtoexceedc) == -1) {
+					break;
+				}
+				curriter++;
+				if (checkpointdue(&opts, curriter) || (snapp && curriter % opts.snapshotevery == 0)) {
+					unpackbytegrid(&bg, grid);
+				}
+				if (checkpointdue(&opts, curriter)) {
+					savecheckpoint(&opts, grid, n, n, 0, 0, n, t, curriter, MPI_COMM_SELF);
+				}
+				if (snapp && curriter % opts.snapshotevery == 0) {
+					takesnapshot(snapp, grid, curriter);
+				}
+			}
+			unpackbytegrid(&bg, grid);
+			freebytegrid(&bg);
+		} else {
+			if (opts.engine == ENGINE_QUADTREE) {
+				// Jump as far as the quadtree can, then finish turn by turn with the int engine
+				struct quadtree qt;
+				if (mallocquadtree(&qt, n, t) == -1) {
+					printf("Could not allocate quadtree\n");
+					MPI_Abort(MPI_COMM_WORLD, 1);
+				}
+				packquadtree(&qt, grid);
+				int jumped = quadtreeadvance(&qt, maxiters, numtoexceedc);
+				unpackquadtree(&qt, grid);
+				printf("Quadtree advanced %d iterations using %zu nodes\n", jumped, qt.numnodes);
+				freequadtree(&qt);
+				curriter += jumped;
+			}
+
+			int **nextgrid = NULL, **gridT = NULL, **nextgridT = NULL;
+			if (opts.stepping == STEP_PINGPONG) {
+				malloc2darray(&nextgrid, n, n);
+			}
+			if (opts.layout == LAYOUT_DUAL) {
+				malloc2darray(&gridT, n, n);
+				if (opts.stepping == STEP_PINGPONG) {
+					malloc2darray(&nextgridT, n, n);
+				}
+			}
+			struct tilecounts counts, *countsp = NULL;
+			if (opts.tilecount == TILES_INCREMENTAL) {
+				malloctilecounts(&counts, n, n, t, 0, 0, tiledimension);
+				filltilecounts(&counts, grid, n, n);
+				countsp = &counts;
+			}
+			struct activity act, *actp = NULL;
+			if (opts.stepping == STEP_ACTIVE) {
+				mallocactivity(&act, n, n, t);
+				actp = &act;
+			}
+			struct tilescheduler sched, *schedp = NULL;
+			if (poolp && opts.schedule == SCHED_STEAL) {
+				malloctilescheduler(&sched, poolp, n, n, t);
+				schedp = &sched;
+			}
+			struct boardhash hash;
+			struct cycledetector detector;
+			int detecting = opts.cycles;
+			if (opts.cycles) {
+				initboardhash(&hash, 0, 0, n);
+				fillboardhash(&hash, grid, n, n);
+				act.hash = &hash;
+				mallocdetector(&detector, n * n * sizeof(int));
+			}
+			while (curriter < maxiters) {
+				solverowhalfturn(&grid, &nextgrid, NULL, n, n, 1, opts.stepping, countsp, actp, poolp, schedp);
+				if (opts.layout == LAYOUT_DUAL) {
+					transposegrid(grid, gridT, n, n);
+					solverowhalfturn(&gridT, &nextgridT, NULL, n, n, 2, opts.stepping, countsp, actp, poolp, schedp);
+					transposegrid(gridT, grid, n, n);
+				} else {
+					solvecolumnhalfturn(&grid, &nextgrid, NULL, n, n, opts.stepping, countsp, actp, poolp, schedp);
+				}
+				int tileresult;
+				if (countsp) {
+					tileresult = checktilecounts(countsp, numtoexceedc);
+				} else if (poolp) {
+					tileresult = threadedcounttiles(poolp, grid, n, n, 0, 0, t, tiledimension, numtoexceedc);
+				} else {
+					tileresult = counttiles(grid, n, n, 0, 0, t, tiledimension, numtiles, numtoexceedc);
+				}
+				if (tileresult == -1) {
+					break;
+				}
+				curriter++;	
+				if (detecting) {
+					int period = checkcycle(&detector, hash.hash, curriter, &grid[0][0], MPI_COMM_SELF);
+					if (period > 0) {
+						curriter = skipcycles(curriter, period, maxiters, rank);
+						detecting = 0;
+					}
+				}
+				if (checkpointdue(&opts, curriter)) {
+					savecheckpoint(&opts, grid, n, n, 0, 0, n, t, curriter, MPI_COMM_SELF);
+				}
+				if (snapp && curriter % opts.snapshotevery == 0) {
+					takesnapshot(snapp, grid, curriter);
+				}
+			}
+			if (opts.cycles) {
+				freedetector(&detector);
+			}
+			if (countsp) {
+				freetilecounts(countsp);
+			}
+			if (actp) {
+				freeactivity(actp);
+			}
+			if (schedp) {
+				freetilescheduler(schedp);
+			}
+		}
+		stopsnapshots(&opts, snapp, rank);
+		if (opts.outputfile) {
+			if (writeboardfile(opts.outputfile, grid, n, n, 0, 0, n, t, curriter, opts.seed, MPI_COMM_SELF) == -1) {
+				printf("Could not write %s\n", opts.outputfile);
+				MPI_Abort(MPI_COMM_WORLD, 1);
 			}
-			curriter++;	
+			printf("Final grid written to %s after %d iterations\n", opts.outputfile, curriter);
+		} else {
+			printf("Final grid \n============ \n");
+			print_grid(grid, n, n);
 		}
-		printf("Final grid \n============ \n");
-		print_grid(grid, n, n);
 	}
 	end = clock();
 	elapsed = (double)(end - start) / CLOCKS_PER_SEC;
 	printf("Execution time for p%d: %f. Started at %f, ended at %f, clocks per sec %d \n", rank, elapsed, (double)start, (double)end, CLOCKS_PER_SEC);
+	if (poolp) {
+		freethreadpool(poolp);
+	}
 	MPI_Finalize();	
 }
 
+/* Prints the whole board from process 0, a band of process rows at a time, so only process 0 holds
+	more than its subgrid and then only one band. Each row of the torus gathers its subgrids into a band
+	on its first process with MPI_Gatherv. The block types are t columns wide, resized to t cells, so
+	a subgrid with an extra tile is just one more block. The bands then go to process 0 in order. */
+void printsubgrids(int **localgrid, int rows, int cols, int leftcolindex, int n, int t, MPI_Comm cartcomm) {
+	int dims[2], periods[2], coords[2];
+	MPI_Cart_get(cartcomm, 2, dims, periods, coords);
+	MPI_Comm rowcomm;
+	int remain[2] = { 0, 1 };
+	MPI_Cart_sub(cartcomm, remain, &rowcomm);
+
+	MPI_Datatype block, localtile, bandtile;
+	int localsizes[2] = { rows, cols }, bandsizes[2] = { rows, n }, subsizes[2] = { rows, t }, starts[2] = { 0, 0 };
+	MPI_Type_create_subarray(2, localsizes, subsizes, starts, MPI_ORDER_C, MPI_INT, &block);
+	MPI_Type_create_resized(block, 0, t * sizeof(int), &localtile);
+	MPI_Type_free(&block);
+	MPI_Type_create_subarray(2, bandsizes, subsizes, starts, MPI_ORDER_C, MPI_INT, &block);
+	MPI_Type_create_resized(block, 0, t * sizeof(int), &bandtile);
+	MPI_Type_free(&block);
+	MPI_Type_commit(&localtile);
+	MPI_Type_commit(&bandtile);
+
+	// Room for the band with the most rows, which after rebalancing need not be the first
+	int maxrows;
+	MPI_Allreduce(&rows, &maxrows, 1, MPI_INT, MPI_MAX, cartcomm);
+	int **band = NULL;
+	int *counts = NULL, *displs = NULL;
+	if (coords[1] == 0) {
+		if (malloc2darray(&band, maxrows, n) == -1) {
+			printf("Could not allocate a band of %d rows for the final grid\n", maxrows);
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		for (int x = 0; x < rows; x++) {				// Any columns after the last whole tile
+			for (int y = 0; y < n; y++) {
+				band[x][y] = 0;
+			}
+		}
+		counts = malloc(dims[1] * sizeof(int));
+		displs = malloc(dims[1] * sizeof(int));
+	}
+	int tiles = cols / t, firsttile = leftcolindex / t;
+	MPI_Gather(&tiles, 1, MPI_INT, counts, 1, MPI_INT, 0, rowcomm);
+	MPI_Gather(&firsttile, 1, MPI_INT, displs, 1, MPI_INT, 0, rowcomm);
+	MPI_Gatherv(&localgrid[0][0], tiles, localtile, band ? &band[0][0] : NULL, counts, displs, bandtile, 0, rowcomm);
+
+	if (coords[0] == 0 && coords[1] == 0) {
+		print_grid(band, rows, n);
+		for (int source = 1; source < dims[0]; source++) {
+			int sourcecoords[2] = { source, 0 }, sourcerank, count;
+			MPI_Status status;
+			MPI_Cart_rank(cartcomm, sourcecoords, &sourcerank);
+			MPI_Recv(&band[0][0], maxrows * n, MPI_INT, sourcerank, 7, cartcomm, &status);
+			MPI_Get_count(&status, MPI_INT, &count);
+			print_grid(band, count / n, n);
+		}
+	} else if (coords[1] == 0) {
+		MPI_Send(&band[0][0], rows * n, MPI_INT, 0, 7, cartcomm);
+	}
+
+	if (band) {
+		free2darray(&band);
+	}
+	free(counts);
+	free(displs);
+	MPI_Type_free(&localtile);
+	MPI_Type_free(&bandtile);
+	MPI_Comm_free(&rowcomm);
+}
+
 /* 
 Gets the dimensions for the 2D torus, based on the number of processes (np). 
 If np is a square number, use those dimensions.
@@ -318,7 +1034,27 @@ void updateleftrow(int **localgrid, int *tempcol, int height) {
 	}
 } 
 
-/* Counts the number of cells in each tile, checking if it exceeds the threshold. */
+/* Turns the neighbour's edge, received before a half-turn, into the buffer the neighbour would send
+	back after it: 3 where one of its cars moves into an empty cell of this subgrid's edge. The edge
+	cells are stride ints apart. */
+void markarrivals(int *ghost, int *edge, int stride, int size, int color) {
+	for (int i = 0; i < size; i++) {
+		ghost[i] = (ghost[i] == color && edge[i * stride] == 0) ? 3 : 0;
+	}
+}
+
+/* Goes back to the first iteration a lagged check found over the threshold, and reports its tiles
+	as the check would have without the lag. Returns the iteration. */
+int rollbacklagcheck(struct lagcheck *lc, int iteration, int **grid, int rows, int cols, struct tilecounts *counts, int maxcells) {
+	restorelagcheck(lc, grid, iteration);
+	filltilecounts(counts, grid, rows, cols);
+	checktilecounts(counts, maxcells);
+	return iteration;
+}
+
+/* Counts the number of cells in each tile, checking if it exceeds the threshold. Only whole tiles
+	are counted, so the cells past the last whole tile of a grid that isn't a multiple of the tile
+	size are left out, as in the other engines. */
 int counttiles(int **localgrid, int height, int width, int toprowindex, int leftcolindex, int tilesize, int tiledimension, int numtiles, int maxcells) {
 	
 	int* numred				= malloc (numtiles * sizeof(int));
@@ -330,10 +1066,17 @@ int counttiles(int **localgrid, int height, int width, int toprowindex, int left
 		numblue[i] = 0;
 	}
 	int result = 0;
+	int wholecells = tiledimension * tilesize;			// Cells across the whole tiles of the grid
 	for (int x = 0; x < height; x++) {
 		int rowindex = toprowindex + x;
+		if (rowindex >= wholecells) {
+			break;
+		}
 		for (int y = 0; y < width; y++) {
 			int colindex = leftcolindex + y;
+			if (colindex >= wholecells) {
+				break;
+			}
 			int tilenum = (rowindex / tilesize) *  tiledimension + (colindex / tilesize);
 			if (localgrid[x][y] == 1) {
 				numred[tilenum]++;
@@ -349,22 +1092,28 @@ int counttiles(int **localgrid, int height, int width, int toprowindex, int left
 			}
 		}
 	}
+	free(numred);
+	free(numblue);
 	return result;
 }
 
 /* Takes the subgrid and changes any "moved" values (ie 3 and 4) and turns it into an empty cell (ie 0) or a cell of the given color respectively.
- Done at the end of each half-turn. */
-void setemptycells(int **subgrid, int height, int width, int intcolor) {
+ Done at the end of each half-turn. Returns the number of marked cells, so 0 means no car moved in or out. */
+int setemptycells(int **subgrid, int height, int width, int intcolor) {
+	int moved = 0;
 	for (int x = 0; x < height; x++) {
 		for (int y = 0; y < width; y++) {
 			if (subgrid[x][y] == 4) {
 				subgrid[x][y] = 0;
+				moved++;
 			}
 			else if (subgrid[x][y] == 3) {
 				subgrid[x][y] = intcolor;
+				moved++;
 			}	
 		} 
 	}
+	return moved;
 }
 
 /* Clears the buffer of moved cell flags. */
@@ -381,7 +1130,7 @@ void setemptybuffercells(int *buf, int size, int color) {
 
 /* Allocates memory for a 2D array. */
 int malloc2darray(int ***array, int x, int y) {
-	int *i = malloc (x * y * sizeof(int));
+	int *i = malloc ((size_t)x * y * sizeof(int));
 	if (!i) {
 		return -1;
 	}
@@ -392,7 +1141,7 @@ int malloc2darray(int ***array, int x, int y) {
 		return -1;
 	}
 	for (int a = 0; a < x; a++) {
-		(*array)[a] = &(i[a * y]);
+		(*array)[a] = &(i[(size_t)a * y]);
 	}
 	return 0;
 }
@@ -403,22 +1152,312 @@ int free2darray(int ***array) {
 	return 0;
 }
 
-/* Initialises values for the grid randomly */
-void  board_init(int** grid, int size) {
-	float max = 1.0;
-	srand(time(NULL));			// Set the random number seed
-	for (int x = 0; x < size; x++) {
-		for (int y = 0; y < size; y++) {
-			float val = ((float)rand()/(float)(RAND_MAX)) * max;
-			if (val <= 0.33) {
-				grid[x][y] = 0;
-			}
-			else if (val <= 0.66) {
-				grid[x][y] = 1; 
+/* Swaps two grids, used to flip between the old and new grid when ping-pong stepping. */
+void swapgrids(int ***a, int ***b) {
+	int **temp = *a;
+	*a = *b;
+	*b = temp;
+}
+
+/* Moves cells of the given color one cell right with the int kernels, leaving the result in *grid.
+	Marker stepping clears the moved cells afterwards; ping-pong stepping writes *nextgrid and swaps.
+	Active stepping solves in place, visiting only the regions act marks as active.
+	If counts is given, it is updated for cars crossing tile edges. A blue row turn is always on the
+	transposed grid of the dual layout. */
+void solverowhalfturn(int ***grid, int ***nextgrid, int *rightbuffer, int height, int width, int color, int stepping, struct tilecounts *counts, struct activity *act, struct threadpool *pool, struct tilescheduler *sched) {
+	if (stepping == STEP_ACTIVE) {
+		solverowturnactive(*grid, rightbuffer, height, width, color, act, counts);
+	} else if (sched) {
+		scheduledrowturn(sched, *grid, *nextgrid, rightbuffer, color, counts);
+		swapgrids(grid, nextgrid);
+	} else if (stepping == STEP_PINGPONG) {
+		solverowturnbuffered(*grid, *nextgrid, rightbuffer, height, width, color);
+		if (counts) {
+			countrowcrossings(counts, *grid, *nextgrid, height, width, color, color == 2, !rightbuffer);
+		}
+		swapgrids(grid, nextgrid);
+	} else if (pool) {
+		threadedrowturn(pool, *grid, rightbuffer, height, width, color, counts);
+	} else {
+		solverowturn(*grid, rightbuffer, height, width, color);
+		if (counts) {
+			countrowcrossings(counts, NULL, *grid, height, width, color, color == 2, !rightbuffer);
+		}
+		setemptycells(*grid, height, width, color);
+	}
+}
+
+/* Moves blue cells one cell down with the int kernels, leaving the result in *grid. */
+void solvecolumnhalfturn(int ***grid, int ***nextgrid, int *botbuffer, int height, int width, int stepping, struct tilecounts *counts, struct activity *act, struct threadpool *pool, struct tilescheduler *sched) {
+	if (stepping == STEP_ACTIVE) {
+		solveblueturnactive(*grid, botbuffer, height, width, act, counts);
+	} else if (sched) {
+		scheduledcolumnturn(sched, *grid, *nextgrid, botbuffer, counts);
+		swapgrids(grid, nextgrid);
+	} else if (stepping == STEP_PINGPONG) {
+		solveblueturnbuffered(*grid, *nextgrid, botbuffer, height, width);
+		if (counts) {
+			countcolumncrossings(counts, *grid, *nextgrid, height, width, !botbuffer);
+		}
+		swapgrids(grid, nextgrid);
+	} else if (pool) {
+		threadedcolumnturn(pool, *grid, botbuffer, height, width, counts);
+	} else {
+		solveblueturn(*grid, botbuffer, height, width);
+		if (counts) {
+			countcolumncrossings(counts, NULL, *grid, height, width, !botbuffer);
+		}
+		setemptycells(*grid, height, width, 2);
+	}
+}
+
+/* Red turn, or the blue turn of the dual layout, with marker stepping and the halo exchanges
+	overlapped. Only the last column's cars need the ghost column, so the other columns move while it
+	is on its way. The cars moving out of the last column then go right while the markers are cleared.
+	Leaves the cars arriving from the left in arrivals, as the blocking exchange does. */
+void overlappedrowturn(int **grid, int height, int width, int color, int *sendcol, int *ghostcol, int *arrivals, int left, int right, int tag, struct tilecounts *counts, MPI_Comm comm) {
+	MPI_Request requests[2];
+	for (int x = 0; x < height; x++) {
+		sendcol[x] = grid[x][0];
+	}
+	MPI_Irecv(ghostcol, height, MPI_INT, right, tag, comm, &requests[0]);
+	MPI_Isend(sendcol, height, MPI_INT, left, tag, comm, &requests[1]);
+	solverowturncolumns(grid, ghostcol, height, width, 0, width - 1, color);
+	MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+	solverowturncolumns(grid, ghostcol, height, width, width - 1, width, color);
+
+	MPI_Irecv(arrivals, height, MPI_INT, left, tag, comm, &requests[0]);
+	MPI_Isend(ghostcol, height, MPI_INT, right, tag, comm, &requests[1]);
+	if (counts) {
+		countrowcrossings(counts, NULL, grid, height, width, color, color == 2, 0);
+	}
+	setemptycells(grid, height, width, color);
+	MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+}
+
+/* Blue turn with marker stepping and the halo exchanges overlapped, as overlappedrowturn. Only the
+	bottom row's cars need the ghost row. */
+void overlappedcolumnturn(int **grid, int height, int width, int *sendrow, int *ghostrow, int *arrivals, int top, int bot, int tag, struct tilecounts *counts, MPI_Comm comm) {
+	MPI_Request requests[2];
+	memcpy(sendrow, grid[0], width * sizeof(int));
+	MPI_Irecv(ghostrow, width, MPI_INT, bot, tag, comm, &requests[0]);
+	MPI_Isend(sendrow, width, MPI_INT, top, tag, comm, &requests[1]);
+	solveblueturnblock(grid, ghostrow, height, 0, height - 1, 0, width);
+	MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+	solveblueturnblock(grid, ghostrow, height, height - 1, height, 0, width);
+
+	MPI_Irecv(arrivals, width, MPI_INT, top, tag, comm, &requests[0]);
+	MPI_Isend(ghostrow, width, MPI_INT, bot, tag, comm, &requests[1]);
+	if (counts) {
+		countcolumncrossings(counts, NULL, grid, height, width, 0);
+	}
+	setemptycells(grid, height, width, 2);
+	MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+}
+
+/* Solves the subgrid with a ghost zone depth cells wide, exchanging halos only every depth iterations.
+	Each process also solves the parts of its neighbours' subgrids held in its ghost zone. Moves off the
+	edge of the padded grid are blocked, and the wrong cells this makes spread in by one cell per turn,
+	so the interior stays exact for depth iterations. Returns the number of iterations completed. */
+int solvedeephalo(int **localgrid, int rows, int cols, int depth, int left, int right, int top, int bot, MPI_Comm comm,
+	struct options *opts, int toprowindex, int leftcolindex, int tilesize, int tiledimension, int numtiles, int maxcells, int curriter, int maxiters, struct threadpool *pool, struct snapshotwriter *snap) {
+	struct deephalo dh;
+	if (createdeephalo(&dh, depth, rows, cols, left, right, top, bot, comm, opts->exchange == EXCHANGE_NEIGHBOR) == -1) {
+		printf("Ghost zone depth %d is larger than the %d x %d subgrid\n", depth, rows, cols);
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	int height = dh.height, width = dh.width;
+	int **grid, **nextgrid = NULL, **gridT = NULL, **nextgridT = NULL;
+	malloc2darray(&grid, height, width);
+	if (opts->stepping == STEP_PINGPONG) {
+		malloc2darray(&nextgrid, height, width);
+	}
+	if (opts->layout == LAYOUT_DUAL) {
+		malloc2darray(&gridT, width, height);
+		if (opts->stepping == STEP_PINGPONG) {
+			malloc2darray(&nextgridT, width, height);
+		}
+	}
+	for (int x = 0; x < rows; x++) {
+		for (int y = 0; y < cols; y++) {
+			grid[depth + x][depth + y] = localgrid[x][y];
+		}
+	}
+
+	// Buffers that block every move off the edge of the padded grid
+	int *blockedrow = malloc(height * sizeof(int));
+	int *blockedcol = malloc(width * sizeof(int));
+	for (int x = 0; x < height; x++) {
+		blockedrow[x] = 1;
+	}
+	for (int y = 0; y < width; y++) {
+		blockedcol[y] = 1;
+	}
+
+	struct activity act, *actp = NULL;
+	if (opts->stepping == STEP_ACTIVE) {
+		mallocactivity(&act, height, width, tilesize);
+		actp = &act;
+	}
+	struct tilescheduler sched, *schedp = NULL;
+	if (pool && opts->schedule == SCHED_STEAL) {
+		malloctilescheduler(&sched, pool, height, width, tilesize);
+		schedp = &sched;
+	}
+
+	int **interior = malloc(rows * sizeof(int*));
+	int sinceexchange = depth;
+	while (curriter < maxiters) {
+		if (sinceexchange == depth) {
+			exchangedeephalo(&dh, grid);
+			if (schedp) {
+				waketiles(schedp);
 			}
-			else {
-				grid[x][y] = 2;
+			if (actp) {
+				for (int x = 0; x < height; x++) {
+					for (int y = 0; y < width; y++) {
+						if (x < depth || x >= depth + rows || y < depth || y >= depth + cols) {
+							wakecell(actp, x, y);
+						}
+					}
+				}
 			}
+			sinceexchange = 0;
+		}
+
+		solverowhalfturn(&grid, &nextgrid, blockedrow, height, width, 1, opts->stepping, NULL, actp, pool, schedp);
+		if (opts->layout == LAYOUT_DUAL) {
+			transposegrid(grid, gridT, height, width);
+			solverowhalfturn(&gridT, &nextgridT, blockedcol, width, height, 2, opts->stepping, NULL, NULL, pool, NULL);
+			transposegrid(gridT, grid, width, height);
+		} else {
+			solvecolumnhalfturn(&grid, &nextgrid, blockedcol, height, width, opts->stepping, NULL, actp, pool, schedp);
+		}
+		sinceexchange++;
+
+		// Check the tiles of the interior only
+		for (int x = 0; x < rows; x++) {
+			interior[x] = grid[depth + x] + depth;
+		}
+		int tileresult;
+		if (pool) {
+			tileresult = threadedcounttiles(pool, interior, rows, cols, toprowindex, leftcolindex, tilesize, tiledimension, maxcells);
+		} else {
+			tileresult = counttiles(interior, rows, cols, toprowindex, leftcolindex, tilesize, tiledimension, numtiles, maxcells);
+		}
+		int allresult = 0;
+		MPI_Allreduce(&tileresult, &allresult, 1, MPI_INT, MPI_MIN, comm);
+		if (allresult == -1) {
+			break;
+		}
+		curriter++;
+		if (checkpointdue(opts, curriter)) {
+			savecheckpoint(opts, interior, rows, cols, toprowindex, leftcolindex, tiledimension * tilesize, tilesize, curriter, comm);
+		}
+		if (snap && curriter % opts->snapshotevery == 0) {
+			takesnapshot(snap, interior, curriter);
+		}
+	}
+
+	for (int x = 0; x < rows; x++) {
+		for (int y = 0; y < cols; y++) {
+			localgrid[x][y] = grid[depth + x][depth + y];
+		}
+	}
+	free(interior);
+	free(blockedrow);
+	free(blockedcol);
+	if (actp) {
+		freeactivity(actp);
+	}
+	if (schedp) {
+		freetilescheduler(schedp);
+	}
+	free2darray(&grid);
+	if (nextgrid) {
+		free2darray(&nextgrid);
+	}
+	if (gridT) {
+		free2darray(&gridT);
+	}
+	if (nextgridT) {
+		free2darray(&nextgridT);
+	}
+	freedeephalo(&dh);
+	return curriter;
+}
+
+/* Replaces the subgrid with its cells of the -restart board. Returns the iterations the board had
+	already run, so the run carries on to the same maxiters. */
+int restartsubgrid(struct options *opts, int **grid, int rows, int cols, int toprow, int leftcol, int n, MPI_Comm comm) {
+	int rank;
+	MPI_Comm_rank(comm, &rank);
+	struct boardheader header;
+	if (readboardfile(opts->restartfile, grid, rows, cols, toprow, leftcol, n, &header, comm) == -1) {
+		if (rank == 0) {
+			printf("Could not read a %d x %d board from %s\n", n, n, opts->restartfile);
+		}
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	opts->seed = header.seed;
+	if (rank == 0) {
+		printf("Restarting from %s after %d iterations, seed %lld\n", opts->restartfile, header.iteration, opts->seed);
+	}
+	return header.iteration;
+}
+
+/* Whether to write a checkpoint once iteration iterations have run. */
+int checkpointdue(struct options *opts, int iteration) {
+	return opts->checkpointfile && iteration % opts->checkpointevery == 0;
+}
+
+void savecheckpoint(struct options *opts, int **grid, int rows, int cols, int toprow, int leftcol, int n, int t, int iteration, MPI_Comm comm) {
+	int rank;
+	MPI_Comm_rank(comm, &rank);
+	if (writecheckpoint(opts->checkpointfile, grid, rows, cols, toprow, leftcol, n, t, iteration, opts->seed, comm) == -1) {
+		if (rank == 0) {
+			printf("Could not write checkpoint %s\n", opts->checkpointfile);
 		}
-	}			
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	if (rank == 0) {
+		printf("Checkpoint written to %s after %d iterations\n", opts->checkpointfile, iteration);
+	}
+}
+
+/* Starts the background writer if -snapshot was given. Returns NULL if not. */
+struct snapshotwriter *startsnapshots(struct options *opts, struct snapshotwriter *sw, int rank, int rows, int cols, int toprow, int leftcol, int n, int t) {
+	if (!opts->snapshotprefix) {
+		return NULL;
+	}
+	if (startsnapshotwriter(sw, opts->snapshotprefix, rank, rows, cols, toprow, leftcol, n, t, opts->seed) == -1) {
+		printf("Could not start the snapshot writer of process %d\n", rank);
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	return sw;
+}
+
+void stopsnapshots(struct options *opts, struct snapshotwriter *sw, int rank) {
+	if (!sw) {
+		return;
+	}
+	int written = stopsnapshotwriter(sw);
+	if (written == -1) {
+		printf("Process %d could not write all its snapshots to %s\n", rank, opts->snapshotprefix);
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	if (rank == 0) {
+		printf("Wrote %d snapshots to %s\n", written, opts->snapshotprefix);
+	}
+}
+
+/* Once the board after curriter iterations is known to repeat every period iterations, jumps ahead by
+	whole periods. The tiles were all under the threshold throughout the cycle, so they stay that way,
+	and the remaining iterations (fewer than one period) are solved as usual. */
+int skipcycles(int curriter, int period, int maxiters, int rank) {
+	int skipped = ((maxiters - curriter) / period) * period;
+	if (rank == 0) {
+		printf("Board repeats every %d iterations from iteration %d, skipping %d iterations\n", period, curriter - period, skipped);
+	}
+	return curriter + skipped;
 }
@@ -0,0 +1,289 @@
+#include "redblueoptions.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Sets the default options, then reads any "-name value" pairs following the 4 required arguments.
+	Returns -1 if an option is unknown or is missing its value. */
+int parseoptions(struct options *opts, int argc, char **argv) {
+	opts->engine = ENGINE_DEFAULT;
+	opts->stepping = STEP_MARKER;
+	opts->layout = LAYOUT_ROW;
+	opts->tilecount = TILES_INCREMENTAL;
+	opts->halodepth = 0;
+	opts->exchange = EXCHANGE_BLOCKING;
+	opts->wire = WIRE_INT;
+	opts->lag = 0;
+	opts->rebalanceevery = 0;
+	opts->cycles = 0;
+	opts->threads = 1;
+	opts->schedule = SCHED_STATIC;
+	opts->boards = 1;
+	opts->seed = -1;
+	opts->red = opts->blue = 1.0 / 3;
+	opts->sweepfile = NULL;
+	opts->densities = NULL;
+	opts->seeds = "1";
+	opts->group = 1;
+	opts->outputfile = NULL;
+	opts->checkpointfile = NULL;
+	opts->checkpointevery = 1000;
+	opts->restartfile = NULL;
+	opts->snapshotprefix = NULL;
+	opts->snapshotevery = 100;
+
+	for (int i = 5; i < argc; i += 2) {
+		if (i + 1 >= argc) {
+			printf("Option %s is missing a value\n", argv[i]);
+			return -1;
+		}
+		char *name = argv[i];
+		char *value = argv[i + 1];
+		if (strcmp(name, "-engine") == 0) {
+			if (strcmp(value, "int") == 0) {
+				opts->engine = ENGINE_INT;
+			} else if (strcmp(value, "bit") == 0) {
+				opts->engine = ENGINE_BIT;
+			} else if (strcmp(value, "simd") == 0) {
+				opts->engine = ENGINE_SIMD;
+			} else if (strcmp(value, "quadtree") == 0) {
+				opts->engine = ENGINE_QUADTREE;
+			} else {
+				printf("Unknown engine %s\n", value);
+				return -1;
+			}
+		} else if (strcmp(name, "-step") == 0) {
+			if (strcmp(value, "marker") == 0) {
+				opts->stepping = STEP_MARKER;
+			} else if (strcmp(value, "pingpong") == 0) {
+				opts->stepping = STEP_PINGPONG;
+			} else if (strcmp(value, "active") == 0) {
+				opts->stepping = STEP_ACTIVE;
+			} else {
+				printf("Unknown stepping %s\n", value);
+				return -1;
+			}
+		} else if (strcmp(name, "-layout") == 0) {
+			if (strcmp(value, "row") == 0) {
+				opts->layout = LAYOUT_ROW;
+			} else if (strcmp(value, "dual") == 0) {
+				opts->layout = LAYOUT_DUAL;
+			} else {
+				printf("Unknown layout %s\n", value);
+				return -1;
+			}
+		} else if (strcmp(name, "-tiles") == 0) {
+			if (strcmp(value, "incremental") == 0) {
+				opts->tilecount = TILES_INCREMENTAL;
+			} else if (strcmp(value, "scan") == 0) {
+				opts->tilecount = TILES_SCAN;
+			} else {
+				printf("Unknown tile count %s\n", value);
+				return -1;
+			}
+		} else if (strcmp(name, "-halo") == 0) {
+			if (strcmp(value, "auto") == 0) {
+				opts->halodepth = -1;
+			} else {
+				opts->halodepth = strtol(value, NULL, 10);
+				if (opts->halodepth < 1) {
+					printf("Ghost zone depth must be at least 1\n");
+					return -1;
+				}
+			}
+		} else if (strcmp(name, "-exchange") == 0) {
+			if (strcmp(value, "blocking") == 0) {
+				opts->exchange = EXCHANGE_BLOCKING;
+			} else if (strcmp(value, "overlap") == 0) {
+				opts->exchange = EXCHANGE_OVERLAP;
+			} else if (strcmp(value, "neighbor") == 0) {
+				opts->exchange = EXCHANGE_NEIGHBOR;
+			} else if (strcmp(value, "single") == 0) {
+				opts->exchange = EXCHANGE_SINGLE;
+			} else {
+				printf("Unknown exchange %s\n", value);
+				return -1;
+			}
+		} else if (strcmp(name, "-wire") == 0) {
+			if (strcmp(value, "int") == 0) {
+				opts->wire = WIRE_INT;
+			} else if (strcmp(value, "bits") == 0) {
+				opts->wire = WIRE_BITS;
+			} else if (strcmp(value, "delta") == 0) {
+				opts->wire = WIRE_DELTA;
+			} else {
+				printf("Unknown wire format %s\n", value);
+				return -1;
+			}
+		} else if (strcmp(name, "-lag") == 0) {
+			opts->lag = strtol(value, NULL, 10);
+			if (opts->lag < 0) {
+				printf("The check lag can't be negative\n");
+				return -1;
+			}
+		} else if (strcmp(name, "-rebalance") == 0) {
+			opts->rebalanceevery = strtol(value, NULL, 10);
+			if (opts->rebalanceevery < 0) {
+				printf("Load balance checks can't be a negative number of iterations apart\n");
+				return -1;
+			}
+		} else if (strcmp(name, "-cycles") == 0) {
+			if (strcmp(value, "on") == 0) {
+				opts->cycles = 1;
+			} else if (strcmp(value, "off") == 0) {
+				opts->cycles = 0;
+			} else {
+				printf("Unknown cycles setting %s\n", value);
+				return -1;
+			}
+		} else if (strcmp(name, "-threads") == 0) {
+			opts->threads = strtol(value, NULL, 10);
+			if (opts->threads < 1) {
+				printf("Number of threads must be at least 1\n");
+				return -1;
+			}
+		} else if (strcmp(name, "-schedule") == 0) {
+			if (strcmp(value, "static") == 0) {
+				opts->schedule = SCHED_STATIC;
+			} else if (strcmp(value, "steal") == 0) {
+				opts->schedule = SCHED_STEAL;
+			} else {
+				printf("Unknown schedule %s\n", value);
+				return -1;
+			}
+		} else if (strcmp(name, "-boards") == 0) {
+			opts->boards = strtol(value, NULL, 10);
+			if (opts->boards < 1 || opts->boards > 64) {
+				printf("Number of boards must be from 1 to 64\n");
+				return -1;
+			}
+		} else if (strcmp(name, "-seed") == 0) {
+			char *end;
+			opts->seed = strtoll(value, &end, 10);
+			if (end == value || *end != '\0' || opts->seed < 0) {
+				printf("Seed must be a number from 0\n");
+				return -1;
+			}
+		} else if (strcmp(name, "-output") == 0) {
+			opts->outputfile = value;
+		} else if (strcmp(name, "-checkpoint") == 0) {
+			opts->checkpointfile = value;
+		} else if (strcmp(name, "-checkpointevery") == 0) {
+			opts->checkpointevery = strtol(value, NULL, 10);
+			if (opts->checkpointevery < 1) {
+				printf("Checkpoints must be at least 1 iteration apart\n");
+				return -1;
+			}
+		} else if (strcmp(name, "-restart") == 0) {
+			opts->restartfile = value;
+		} else if (strcmp(name, "-snapshot") == 0) {
+			opts->snapshotprefix = value;
+		} else if (strcmp(name, "-snapshotevery") == 0) {
+			opts->snapshotevery = strtol(value, NULL, 10);
+			if (opts->snapshotevery < 1) {
+				printf("Snapshots must be at least 1 iteration apart\n");
+				return -1;
+			}
+		} else if (strcmp(name, "-sweep") == 0) {
+			opts->sweepfile = value;
+		} else if (strcmp(name, "-density") == 0) {
+			opts->densities = value;
+		} else if (strcmp(name, "-seeds") == 0) {
+			opts->seeds = value;
+		} else if (strcmp(name, "-group") == 0) {
+			opts->group = strtol(value, NULL, 10);
+			if (opts->group < 1) {
+				printf("Group size must be at least 1\n");
+				return -1;
+			}
+		} else {
+			printf("Unknown option %s\n", name);
+			return -1;
+		}
+	}
+
+	int intoptions = opts->stepping != STEP_MARKER || opts->layout != LAYOUT_ROW || opts->tilecount != TILES_INCREMENTAL || opts->threads > 1 || opts->schedule != SCHED_STATIC;
+	int splitoptions = opts->halodepth != 0 || opts->exchange != EXCHANGE_BLOCKING || opts->wire != WIRE_INT || opts->lag > 0 || opts->rebalanceevery > 0;
+	if (intoptions && (opts->engine == ENGINE_BIT || opts->engine == ENGINE_SIMD)) {
+		printf("-step, -layout, -tiles, -threads and -schedule need the int engine\n");
+		return -1;
+	}
+	if (opts->stepping == STEP_ACTIVE && opts->layout != LAYOUT_ROW) {
+		printf("Active stepping needs the row layout\n");
+		return -1;
+	}
+	if (opts->threads > 1 && opts->schedule == SCHED_STATIC && (opts->stepping != STEP_MARKER || opts->layout != LAYOUT_ROW)) {
+		printf("Threads need marker stepping and the row layout, or -schedule steal\n");
+		return -1;
+	}
+	if (opts->threads > 1 && opts->schedule == SCHED_STEAL && (opts->stepping != STEP_PINGPONG || opts->layout != LAYOUT_ROW)) {
+		printf("The work stealing schedule needs ping-pong stepping and the row layout\n");
+		return -1;
+	}
+	if (opts->exchange == EXCHANGE_OVERLAP && (opts->stepping != STEP_MARKER || opts->threads > 1 || opts->halodepth != 0)) {
+		printf("Overlapped exchanges need marker stepping, one thread and the 1 cell halos\n");
+		return -1;
+	}
+	if (opts->exchange == EXCHANGE_SINGLE && opts->halodepth != 0) {
+		printf("Single exchanges per half-turn need the 1 cell halos\n");
+		return -1;
+	}
+	if (opts->wire != WIRE_INT && (opts->exchange != EXCHANGE_BLOCKING || opts->halodepth != 0)) {
+		printf("Compressed halos need the blocking exchange and the 1 cell halos\n");
+		return -1;
+	}
+	if (opts->lag > 0 && (opts->tilecount != TILES_INCREMENTAL || opts->cycles || opts->halodepth != 0)) {
+		printf("Lagged checks need incremental tile counts, no cycle detection and the 1 cell halos\n");
+		return -1;
+	}
+	if (opts->rebalanceevery > 0 && (opts->halodepth != 0 || opts->cycles || opts->snapshotprefix || opts->exchange == EXCHANGE_OVERLAP)) {
+		printf("Rebalancing needs the 1 cell halos, and can't be combined with -cycles, -snapshot or overlapped exchanges\n");
+		return -1;
+	}
+	if (opts->boards > 1 && (opts->engine != ENGINE_DEFAULT || intoptions || splitoptions || opts->cycles)) {
+		printf("Multiple boards run on their own kernels, so they can't be combined with -engine, -step, -layout, -tiles, -threads, -schedule, -halo, -exchange, -wire, -lag, -rebalance or -cycles\n");
+		return -1;
+	}
+	if (!opts->sweepfile && (strcmp(opts->seeds, "1") != 0 || opts->group != 1)) {
+		printf("-seeds and -group are only used by -sweep\n");
+		return -1;
+	}
+	if (opts->sweepfile && opts->seed != -1) {
+		printf("A sweep takes its seeds from -seeds\n");
+		return -1;
+	}
+	if (!opts->sweepfile && opts->densities) {
+		char *end;
+		double density = strtod(opts->densities, &end);
+		if (*end == '/') {
+			char *blue = end + 1;
+			opts->red = density;
+			opts->blue = strtod(blue, &end);
+			if (end == blue) {
+				end = opts->densities;
+			}
+		} else {
+			opts->red = opts->blue = density / 2;
+		}
+		if (end == opts->densities || *end != '\0' || opts->red < 0 || opts->blue < 0 || opts->red + opts->blue > 1) {
+			printf("Density must be \"d\" or \"red/blue\", at least 0 and adding up to at most 1\n");
+			return -1;
+		}
+	}
+	if (opts->sweepfile && (opts->boards > 1 || opts->engine != ENGINE_DEFAULT || intoptions || splitoptions || opts->cycles)) {
+		printf("A sweep runs its own kernels, so it can't be combined with -boards, -engine, -step, -layout, -tiles, -threads, -schedule, -halo, -exchange, -wire, -lag, -rebalance or -cycles\n");
+		return -1;
+	}
+	if ((opts->outputfile || opts->checkpointfile || opts->restartfile || opts->snapshotprefix) && (opts->boards > 1 || opts->sweepfile)) {
+		printf("-output, -checkpoint, -restart and -snapshot work on a single board, so they can't be combined with -boards or -sweep\n");
+		return -1;
+	}
+	if (opts->restartfile && opts->seed != -1) {
+		printf("A restart takes its board from the file, not from -seed\n");
+		return -1;
+	}
+	if (opts->engine == ENGINE_DEFAULT && intoptions) {
+		opts->engine = ENGINE_INT;
+	}
+	return 0;
+}
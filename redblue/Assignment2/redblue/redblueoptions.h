@@ -0,0 +1,70 @@
+#ifndef REDBLUE_OPTIONS
+#define REDBLUE_OPTIONS
+
+// Kernels used to advance the board
+#define ENGINE_DEFAULT	-1		// Not chosen: bit on one process, int when an int engine option is given or the board is split
+#define ENGINE_INT		0		// One int per cell, solveredturn/solveblueturn
+#define ENGINE_BIT		1		// Red and blue bit planes, 64 cells per word
+#define ENGINE_SIMD		2		// One byte per cell, AVX2/AVX-512 turns
+#define ENGINE_QUADTREE	3		// Hash-consed quadtree jumping many iterations at once, then the int engine
+
+// How the int engine steps a half-turn
+#define STEP_MARKER		0		// In place, marking moved cells 3/4 and clearing them with setemptycells
+#define STEP_PINGPONG	1		// Read the old grid, write the new one, then swap
+#define STEP_ACTIVE		2		// In place without markers, skipping rows/columns of tiles that are jammed
+
+// How the threads share out a half-turn
+#define SCHED_STATIC	0		// One band of rows or columns per thread
+#define SCHED_STEAL		1		// One task per tile, idle threads taking tasks from busy ones (ping-pong stepping)
+
+// How the int engine lays out the grid for the blue turn
+#define LAYOUT_ROW		0		// Blue moves read the row below, width ints away
+#define LAYOUT_DUAL		1		// Blue turn runs on a tile-by-tile transposed copy, so it reads along rows
+
+// How the distributed path swaps the 1 cell halos
+#define EXCHANGE_BLOCKING	0	// MPI_Sendrecv before and after each half-turn
+#define EXCHANGE_OVERLAP	1	// MPI_Isend/MPI_Irecv, moving the cars away from the halo edge while they complete
+#define EXCHANGE_NEIGHBOR	2	// MPI_Neighbor_alltoallw on the torus communicator
+#define EXCHANGE_SINGLE		3	// One MPI_Neighbor_alltoallw per half-turn, with ghost cells on both sides
+
+// Format of the 1 cell halo messages of the blocking exchange
+#define WIRE_INT		0		// One MPI_INT per cell
+#define WIRE_BITS		1		// One bit per cell
+#define WIRE_DELTA		2		// The positions of the bits that changed since the last message, when shorter than the bits
+
+// How the int engine finds tiles over the threshold
+#define TILES_INCREMENTAL	0	// Per-tile counts updated when cars cross tile edges
+#define TILES_SCAN			1	// counttiles rescans every cell each iteration
+
+struct options {
+	int engine;
+	int stepping;
+	int layout;
+	int tilecount;
+	int halodepth;				// Ghost zone depth for the distributed path: 0 for the 1 cell buffers, -1 to choose it
+	int exchange;				// How the halos are swapped
+	int wire;					// Format of the halo messages
+	int lag;					// Iterations run while each threshold check is reduced, 0 to wait for it
+	int rebalanceevery;			// Iterations between checks of the load balance, 0 to keep the first split
+	int cycles;					// Find repeated boards and skip ahead to maxiters
+	int threads;				// Threads per process for the int kernels
+	int schedule;				// How the threads share out a half-turn
+	int boards;					// Boards each process runs at once, bit-sliced when more than 1
+	long long seed;				// Key of the starting board's random numbers, -1 to take it from the clock
+	double red;					// Fractions of red and blue cells on the starting board
+	double blue;
+	char *sweepfile;			// CSV file for a parameter sweep, or NULL for a single run
+	char *densities;			// Car densities, "d" (half red, half blue) or "red/blue"; lists or ranges of d for a sweep
+	char *seeds;				// Sweep seeds, as a list or range like the 4 required arguments
+	int group;					// Processes sharing each run of a sweep
+	char *outputfile;			// Binary file for the final board, or NULL to print it
+	char *checkpointfile;		// Binary file rewritten with the board every checkpointevery iterations
+	int checkpointevery;
+	char *restartfile;			// Board to start from instead of a random one, binary or text
+	char *snapshotprefix;		// Snapshots of each subgrid every snapshotevery iterations, written in the background
+	int snapshotevery;
+};
+
+int parseoptions(struct options *opts, int argc, char **argv);
+
+#endif
@@ -1,10 +1,23 @@
 #include "redblueprocedure.h"
+#include <stddef.h>
 
 /* Iterates through the given grid and moves valid red cells. */
 void solveredturn(int **subgrid, int *rightbuffer, int height, int width) {
+	solverowturn(subgrid, rightbuffer, height, width, 1);
+}
+
+/* Iterates through the given grid and moves valid cells of the given color one cell to the right.
+	This is the red turn, or the blue turn on a transposed grid. */
+void solverowturn(int **subgrid, int *rightbuffer, int height, int width, int color) {
+	solverowturncolumns(subgrid, rightbuffer, height, width, 0, width, color);
+}
+
+/* Moves the cars starting in columns firstcol to lastcol - 1 only. Each row is solved left to right,
+	so solving the columns in two parts in order gives the same result as solving them in one. */
+void solverowturncolumns(int **subgrid, int *rightbuffer, int height, int width, int firstcol, int lastcol, int color) {
 	for (int x = 0; x < height; x++) {
-		for (int y = 0; y < width; y++) {
-			if (subgrid[x][y] == 1) {				// If this cell is red
+		for (int y = firstcol; y < lastcol; y++) {
+			if (subgrid[x][y] == color) {			// If this cell is the moving color
 				if (y < width - 1) {				// If this isn't the right edge cell
 					if (subgrid[x][y + 1] == 0) {	// If the cell to the right is white
 						subgrid[x][y + 1] = 3;		// Mark it as just moved in
@@ -31,8 +44,20 @@ void solveredturn(int **subgrid, int *rightbuffer, int height, int width) {
 
 /* Iterates through the given grid and moves valid blue cells. */
 void solveblueturn(int **subgrid, int *botbuffer, int height, int width) {
-	for (int x = 0; x < height; x++) {
-		for (int y = 0; y < width; y++) {
+	solveblueturncolumns(subgrid, botbuffer, height, 0, width);
+}
+
+/* Moves valid blue cells in columns firstcol to lastcol - 1 only. Blue cars stay in their column,
+	so different columns can be solved at the same time. */
+void solveblueturncolumns(int **subgrid, int *botbuffer, int height, int firstcol, int lastcol) {
+	solveblueturnblock(subgrid, botbuffer, height, 0, height, firstcol, lastcol);
+}
+
+/* Moves the blue cars starting in rows firstrow to lastrow - 1 of columns firstcol to lastcol - 1.
+	Rows are solved top to bottom, so solving them in two parts in order gives the same result. */
+void solveblueturnblock(int **subgrid, int *botbuffer, int height, int firstrow, int lastrow, int firstcol, int lastcol) {
+	for (int x = firstrow; x < lastrow; x++) {
+		for (int y = firstcol; y < lastcol; y++) {
 			if (subgrid[x][y] == 2) {
 				if (x < height - 1)	{				// If this isn't the bottom edge cell
 					if (subgrid[x + 1][y] == 0)	{	// If the cell below is white
@@ -60,3 +85,102 @@ void solveblueturn(int **subgrid, int *botbuffer, int height, int width) {
 	}
 }
 
+
+/* Red turn that reads oldgrid and writes every cell of newgrid, so no moved markers are left to clear.
+	Only a car leaving into rightbuffer is still marked with a 3 for the neighbour. */
+void solveredturnbuffered(int **oldgrid, int **newgrid, int *rightbuffer, int height, int width) {
+	solverowturnbuffered(oldgrid, newgrid, rightbuffer, height, width, 1);
+}
+
+/* Buffered version of solverowturn, moving cells of the given color one cell to the right. */
+void solverowturnbuffered(int **oldgrid, int **newgrid, int *rightbuffer, int height, int width, int color) {
+	for (int x = 0; x < height; x++) {
+		int *old = oldgrid[x];
+		int *new = newgrid[x];
+		if (width == 1) {
+			new[0] = old[0];
+		} else {
+			new[0] = (old[0] == color && old[1] == 0) ? 0 : old[0];
+			for (int y = 1; y < width - 1; y++) {
+				int out = old[y] == color && old[y + 1] == 0;
+				int in = old[y - 1] == color && old[y] == 0;
+				new[y] = out ? 0 : (in ? color : old[y]);
+			}
+			new[width - 1] = (old[width - 2] == color && old[width - 1] == 0) ? color : old[width - 1];
+		}
+
+		if (old[width - 1] == color) {					// The last column moves out of the subgrid
+			if (!rightbuffer) {
+				if (new[0] == 0) {						// Wrap against the new state of column 0
+					new[0] = color;
+					new[width - 1] = 0;
+				}
+			} else if (rightbuffer[x] == 0) {
+				rightbuffer[x] = 3;
+				new[width - 1] = 0;
+			}
+		}
+	}
+}
+
+/* Blue turn that reads oldgrid and writes every cell of newgrid, so no moved markers are left to clear.
+	Only a car leaving into botbuffer is still marked with a 3 for the neighbour. */
+void solveblueturnbuffered(int **oldgrid, int **newgrid, int *botbuffer, int height, int width) {
+	for (int x = 0; x < height; x++) {
+		int *above = x > 0 ? oldgrid[x - 1] : NULL;
+		int *old = oldgrid[x];
+		int *below = x < height - 1 ? oldgrid[x + 1] : NULL;
+		int *new = newgrid[x];
+		if (!above && !below) {
+			for (int y = 0; y < width; y++) {
+				new[y] = old[y];
+			}
+		} else if (!above) {
+			for (int y = 0; y < width; y++) {
+				new[y] = (old[y] == 2 && below[y] == 0) ? 0 : old[y];
+			}
+		} else if (!below) {
+			for (int y = 0; y < width; y++) {
+				new[y] = (above[y] == 2 && old[y] == 0) ? 2 : old[y];
+			}
+		} else {
+			for (int y = 0; y < width; y++) {
+				int out = old[y] == 2 && below[y] == 0;
+				int in = above[y] == 2 && old[y] == 0;
+				new[y] = out ? 0 : (in ? 2 : old[y]);
+			}
+		}
+	}
+
+	int *old = oldgrid[height - 1];						// The bottom row moves out of the subgrid
+	int *new = newgrid[height - 1];
+	for (int y = 0; y < width; y++) {
+		if (old[y] == 2) {
+			if (!botbuffer) {
+				if (newgrid[0][y] == 0) {				// Wrap against the new state of row 0
+					newgrid[0][y] = 2;
+					new[y] = 0;
+				}
+			} else if (botbuffer[y] == 0) {
+				botbuffer[y] = 3;
+				new[y] = 0;
+			}
+		}
+	}
+}
+
+/* Copies the transpose of src (height x width) into dst (width x height), a block at a time
+	so both grids are read and written a few cache lines at once. */
+void transposegrid(int **src, int **dst, int height, int width) {
+	for (int bx = 0; bx < height; bx += TRANSPOSE_BLOCK) {
+		int xend = bx + TRANSPOSE_BLOCK < height ? bx + TRANSPOSE_BLOCK : height;
+		for (int by = 0; by < width; by += TRANSPOSE_BLOCK) {
+			int yend = by + TRANSPOSE_BLOCK < width ? by + TRANSPOSE_BLOCK : width;
+			for (int x = bx; x < xend; x++) {
+				for (int y = by; y < yend; y++) {
+					dst[y][x] = src[x][y];
+				}
+			}
+		}
+	}
+}
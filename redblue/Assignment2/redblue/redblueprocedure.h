@@ -1,8 +1,38 @@
 #ifndef REDBLUE_PROC
 #define REDBLUE_PROC
 
+#define TRANSPOSE_BLOCK 32			// Cells per side of the blocks transposegrid copies
+
 void solveredturn(int **subgrid, int *rightbuffer, int height, int width);
 
+void solverowturn(int **subgrid, int *rightbuffer, int height, int width, int color);
+
+void solverowturncolumns(int **subgrid, int *rightbuffer, int height, int width, int firstcol, int lastcol, int color);
+
 void solveblueturn(int **subgrid, int *botbuffer, int height, int width);
 
+void solveblueturncolumns(int **subgrid, int *botbuffer, int height, int firstcol, int lastcol);
+
+void solveblueturnblock(int **subgrid, int *botbuffer, int height, int firstrow, int lastrow, int firstcol, int lastcol);
+
+void solveredturnbuffered(int **oldgrid, int **newgrid, int *rightbuffer, int height, int width);
+
+void solverowturnbuffered(int **oldgrid, int **newgrid, int *rightbuffer, int height, int width, int color);
+
+void solveblueturnbuffered(int **oldgrid, int **newgrid, int *botbuffer, int height, int width);
+
+void transposegrid(int **src, int **dst, int height, int width);
+
+// Grid helpers defined in redblue.c, shared with the other modules
+
+int malloc2darray(int ***array, int x, int y);
+
+int free2darray(int ***array);
+
+int setemptycells(int **subgrid, int height, int width, int intcolor);
+
+void updatetoprow(int *toprow, int *tempbuffer, int size);
+
+void updateleftrow(int **localgrid, int *tempcol, int height);
+
 #endif
@@ -0,0 +1,61 @@
+#include "rng.h"
+
+#define PHILOX_M0	0xD2511F53u
+#define PHILOX_M1	0xCD9E8D57u
+#define PHILOX_W0	0x9E3779B9u		// Key schedule constants
+#define PHILOX_W1	0xBB67AE85u
+#define PHILOX_ROUNDS	10
+
+/* Philox4x32 with 10 rounds, as in Random123. */
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]) {
+	uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+	uint32_t k0 = key[0], k1 = key[1];
+	for (int round = 0; round < PHILOX_ROUNDS; round++) {
+		uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+		uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+		c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+		c1 = (uint32_t)p1;
+		c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+		c3 = (uint32_t)p0;
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+/* Sets up the generator for one board. red and blue are the fractions of cells of each color. */
+void initboardrng(struct boardrng *rng, uint64_t seed, uint32_t stream, double red, double blue) {
+	rng->key[0] = (uint32_t)seed;
+	rng->key[1] = (uint32_t)(seed >> 32);
+	rng->stream = stream;
+	rng->redlimit = (uint64_t)(red * 4294967296.0);
+	rng->bluelimit = (uint64_t)((red + blue) * 4294967296.0);
+}
+
+/* Fills a height x width part of the board whose top left cell is (toprow, leftcol). */
+void fillboard(struct boardrng *rng, int **grid, int height, int width, int toprow, int leftcol) {
+	for (int x = 0; x < height; x++) {
+		uint32_t counter[4] = { 0, (uint32_t)(toprow + x), rng->stream, 0 };
+		uint32_t draws[4];
+		int block = -1;
+		for (int y = 0; y < width; y++) {
+			int col = leftcol + y;
+			if (col / 4 != block) {
+				block = col / 4;
+				counter[0] = (uint32_t)block;
+				philox4x32(counter, rng->key, draws);
+			}
+			uint32_t draw = draws[col % 4];
+			if (draw < rng->redlimit) {
+				grid[x][y] = 1;
+			} else if (draw < rng->bluelimit) {
+				grid[x][y] = 2;
+			} else {
+				grid[x][y] = 0;
+			}
+		}
+	}
+}
@@ -0,0 +1,23 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/* Counter-based generator for the starting board. Each cell is drawn from Philox4x32-10 with the
+	seed as the key and its global row, column and a stream number in the counter, so any process or
+	thread can fill any part of the board and get the same cells for a seed. One call gives the
+	cells of 4 columns. */
+struct boardrng {
+	uint32_t key[2];
+	uint32_t stream;			// Board number, for runs with more than one board
+	uint64_t redlimit;			// A draw below redlimit is red, below bluelimit is blue, otherwise white
+	uint64_t bluelimit;
+};
+
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]);
+
+void initboardrng(struct boardrng *rng, uint64_t seed, uint32_t stream, double red, double blue);
+
+void fillboard(struct boardrng *rng, int **grid, int height, int width, int toprow, int leftcol);
+
+#endif
@@ -0,0 +1,173 @@
+#include "snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* PackBits: a header byte h then either h + 1 literal bytes (h < 128), or one byte repeated 257 - h
+	times (h > 128). Returns the compressed size, at most size + size / 128 + 1. */
+static size_t packbits(const unsigned char *in, size_t size, unsigned char *out) {
+	size_t i = 0, o = 0;
+	while (i < size) {
+		size_t run = 1;
+		while (i + run < size && run < 128 && in[i + run] == in[i]) {
+			run++;
+		}
+		if (run >= 3) {
+			out[o++] = (unsigned char)(257 - run);
+			out[o++] = in[i];
+			i += run;
+			continue;
+		}
+		// Literals up to the next run of 3
+		size_t start = i, count = 0;
+		while (i < size && count < 128) {
+			if (i + 2 < size && in[i] == in[i + 1] && in[i] == in[i + 2]) {
+				break;
+			}
+			i++;
+			count++;
+		}
+		out[o++] = (unsigned char)(count - 1);
+		memcpy(out + o, in + start, count);
+		o += count;
+	}
+	return o;
+}
+
+static int writesnapshot(struct snapshotwriter *sw, struct snapshotheader *header) {
+	size_t cells = (size_t)header->rows * header->cols;
+	size_t packedbytes = (cells + 3) / 4;
+	memset(sw->packed, 0, packedbytes);
+	for (size_t i = 0; i < cells; i++) {
+		sw->packed[i / 4] |= (unsigned char)(sw->working[i] << (2 * (i % 4)));
+	}
+	header->packedbytes = packedbytes;
+	header->compressedbytes = packbits(sw->packed, packedbytes, sw->compressed);
+
+	char path[4096];
+	snprintf(path, sizeof(path), "%s.%d.%d", sw->prefix, header->iteration, sw->rank);
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		return -1;
+	}
+	int result = fwrite(header, sizeof(*header), 1, file) == 1
+		&& fwrite(sw->compressed, 1, header->compressedbytes, file) == (size_t)header->compressedbytes ? 0 : -1;
+	if (fclose(file) != 0) {
+		result = -1;
+	}
+	return result;
+}
+
+static void *writermain(void *arg) {
+	struct snapshotwriter *sw = arg;
+	pthread_mutex_lock(&sw->lock);
+	while (1) {
+		while (!sw->pending && !sw->stop) {
+			pthread_cond_wait(&sw->staged, &sw->lock);
+		}
+		if (!sw->pending) {
+			break;
+		}
+		int *swap = sw->working;
+		sw->working = sw->staging;
+		sw->staging = swap;
+		struct snapshotheader header = sw->header;
+		sw->pending = 0;
+		pthread_cond_signal(&sw->taken);
+		pthread_mutex_unlock(&sw->lock);
+
+		int result = writesnapshot(sw, &header);
+
+		pthread_mutex_lock(&sw->lock);
+		if (result == -1) {
+			sw->failed = 1;
+		} else {
+			sw->written++;
+		}
+	}
+	pthread_mutex_unlock(&sw->lock);
+	return NULL;
+}
+
+/* Allocates the buffers for snapshots of a rows x cols subgrid and starts the writer. Files are named
+	prefix.iteration.rank. Returns -1 if the buffers or thread can't be had. */
+int startsnapshotwriter(struct snapshotwriter *sw, const char *prefix, int rank, int rows, int cols, int toprow, int leftcol, int n, int t, long long seed) {
+	size_t cells = (size_t)rows * cols;
+	size_t packedbytes = (cells + 3) / 4;
+	memset(sw, 0, sizeof(*sw));
+	sw->prefix = prefix;
+	sw->rank = rank;
+	sw->staging = malloc(cells * sizeof(int));
+	sw->working = malloc(cells * sizeof(int));
+	sw->packed = malloc(packedbytes);
+	sw->compressed = malloc(packedbytes + packedbytes / 128 + 1);
+	if (!sw->staging || !sw->working || !sw->packed || !sw->compressed) {
+		free(sw->staging);
+		free(sw->working);
+		free(sw->packed);
+		free(sw->compressed);
+		return -1;
+	}
+	memcpy(sw->header.magic, SNAPSHOTMAGIC, sizeof(sw->header.magic));
+	sw->header.n = n;
+	sw->header.t = t;
+	sw->header.toprow = toprow;
+	sw->header.leftcol = leftcol;
+	sw->header.rows = rows;
+	sw->header.cols = cols;
+	sw->header.seed = seed;
+	pthread_mutex_init(&sw->lock, NULL);
+	pthread_cond_init(&sw->staged, NULL);
+	pthread_cond_init(&sw->taken, NULL);
+	if (pthread_create(&sw->thread, NULL, writermain, sw) != 0) {
+		pthread_mutex_destroy(&sw->lock);
+		pthread_cond_destroy(&sw->staged);
+		pthread_cond_destroy(&sw->taken);
+		free(sw->staging);
+		free(sw->working);
+		free(sw->packed);
+		free(sw->compressed);
+		return -1;
+	}
+	return 0;
+}
+
+/* Copies the subgrid into staging for the writer. Only waits if the writer hasn't yet taken the last
+	snapshot, that is if writing one takes longer than the iterations between them. */
+void takesnapshot(struct snapshotwriter *sw, int **grid, int iteration) {
+	pthread_mutex_lock(&sw->lock);
+	while (sw->pending) {
+		pthread_cond_wait(&sw->taken, &sw->lock);
+	}
+	pthread_mutex_unlock(&sw->lock);
+
+	// The writer only touches staging while pending is set, so the copy needs no lock
+	for (int x = 0; x < sw->header.rows; x++) {
+		memcpy(sw->staging + (size_t)x * sw->header.cols, grid[x], sw->header.cols * sizeof(int));
+	}
+
+	pthread_mutex_lock(&sw->lock);
+	sw->header.iteration = iteration;
+	sw->pending = 1;
+	pthread_cond_signal(&sw->staged);
+	pthread_mutex_unlock(&sw->lock);
+}
+
+/* Writes any staged snapshot and stops the writer. Returns the number of snapshots written, or -1 if
+	any of them couldn't be. */
+int stopsnapshotwriter(struct snapshotwriter *sw) {
+	pthread_mutex_lock(&sw->lock);
+	sw->stop = 1;
+	pthread_cond_signal(&sw->staged);
+	pthread_mutex_unlock(&sw->lock);
+	pthread_join(sw->thread, NULL);
+
+	pthread_mutex_destroy(&sw->lock);
+	pthread_cond_destroy(&sw->staged);
+	pthread_cond_destroy(&sw->taken);
+	free(sw->staging);
+	free(sw->working);
+	free(sw->packed);
+	free(sw->compressed);
+	return sw->failed ? -1 : sw->written;
+}
@@ -0,0 +1,52 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+/* Snapshot file, one per process and snapshot: this header, then the subgrid's cells in row-major
+	order at 2 bits per cell as in a board file, compressed with PackBits run-length encoding. */
+#define SNAPSHOTMAGIC	"RBSNAP01"
+
+struct snapshotheader {
+	char magic[8];
+	int32_t n;
+	int32_t t;
+	int32_t iteration;
+	int32_t toprow;				// Top left cell of the subgrid on the board
+	int32_t leftcol;
+	int32_t rows;
+	int32_t cols;
+	int32_t reserved;
+	int64_t seed;
+	int64_t packedbytes;		// Bytes of 2 bit cells before compression
+	int64_t compressedbytes;	// Bytes after the header
+};
+
+/* A thread writing snapshots in the background. The loop copies its subgrid into staging and carries
+	on; the writer swaps staging for its own buffer, then packs, compresses and writes it. */
+struct snapshotwriter {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t staged;		// A snapshot is waiting in staging, or the writer should stop
+	pthread_cond_t taken;		// The writer took the staged snapshot
+	const char *prefix;
+	int rank;
+	int *staging;
+	int *working;
+	unsigned char *packed;
+	unsigned char *compressed;
+	struct snapshotheader header;	// Of the staged snapshot
+	int pending;
+	int stop;
+	int failed;					// A snapshot could not be written
+	int written;
+};
+
+int startsnapshotwriter(struct snapshotwriter *sw, const char *prefix, int rank, int rows, int cols, int toprow, int leftcol, int n, int t, long long seed);
+
+void takesnapshot(struct snapshotwriter *sw, int **grid, int iteration);
+
+int stopsnapshotwriter(struct snapshotwriter *sw);
+
+#endif
@@ -0,0 +1,386 @@
+#include "sweep.h"
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "redblueprocedure.h"
+#include "rng.h"
+
+/* Grids and buffers kept between the runs of a sweep, grown when a run needs more. */
+struct sweepbuffers {
+	int *band;					// This process's rows of the board
+	int **bandrows;
+	int *rightbuffer;
+	int *botbuffer;
+	int *tempbotbuffer;
+	int *numred;				// Per tile counts for one row of tiles
+	int *numblue;
+	int bandcells;				// Room in each buffer
+	int bandrowcap;
+	int rowcap;					// Room in rightbuffer
+	int widthcap;				// Room in the other row buffers
+};
+
+/* Reads a list "a,b,c", a range "first:last:step", or a single value into a new array.
+	Returns the number of values, or -1 if the spec can't be read. */
+int parsespec(const char *spec, double **values) {
+	char *end;
+	double first = strtod(spec, &end);
+	if (end == spec) {
+		return -1;
+	}
+	if (*end == ':') {
+		char *next = end + 1;
+		double last = strtod(next, &end);
+		if (end == next || *end != ':') {
+			return -1;
+		}
+		next = end + 1;
+		double step = strtod(next, &end);
+		if (end == next || *end != '\0' || step <= 0 || last < first) {
+			return -1;
+		}
+		int count = (int)((last - first) / step + 1e-9) + 1;
+		*values = malloc(count * sizeof(double));
+		for (int i = 0; i < count; i++) {
+			(*values)[i] = first + i * step;
+		}
+		return count;
+	}
+
+	int count = 1;
+	for (const char *c = spec; *c; c++) {
+		count += *c == ',';
+	}
+	*values = malloc(count * sizeof(double));
+	(*values)[0] = first;
+	for (int i = 1; i < count; i++) {
+		if (*end != ',') {
+			free(*values);
+			return -1;
+		}
+		char *next = end + 1;
+		(*values)[i] = strtod(next, &end);
+		if (end == next) {
+			free(*values);
+			return -1;
+		}
+	}
+	if (*end != '\0') {
+		free(*values);
+		return -1;
+	}
+	return count;
+}
+
+static int growints(int **buffer, int *capacity, int size) {
+	if (size <= *capacity) {
+		return 0;
+	}
+	int *grown = realloc(*buffer, size * sizeof(int));
+	if (!grown) {
+		return -1;
+	}
+	*buffer = grown;
+	*capacity = size;
+	return 0;
+}
+
+static int growrows(int ***rows, int *capacity, int size) {
+	if (size <= *capacity) {
+		return 0;
+	}
+	int **grown = realloc(*rows, size * sizeof(int*));
+	if (!grown) {
+		return -1;
+	}
+	*rows = grown;
+	*capacity = size;
+	return 0;
+}
+
+/* Makes room for a run with rows x n of the board on this process, then points the row pointers at
+	rows of width n. */
+static int fitsweepbuffers(struct sweepbuffers *sb, int rows, int n) {
+	if (growints(&sb->band, &sb->bandcells, rows * n) == -1 || growrows(&sb->bandrows, &sb->bandrowcap, rows) == -1) {
+		return -1;
+	}
+	for (int x = 0; x < rows; x++) {
+		sb->bandrows[x] = sb->band + x * n;
+	}
+	if (growints(&sb->rightbuffer, &sb->rowcap, rows) == -1) {
+		return -1;
+	}
+	if (n > sb->widthcap) {
+		int **buffers[4] = { &sb->botbuffer, &sb->tempbotbuffer, &sb->numred, &sb->numblue };
+		for (int i = 0; i < 4; i++) {
+			int capacity = sb->widthcap;
+			if (growints(buffers[i], &capacity, n) == -1) {
+				return -1;
+			}
+		}
+		sb->widthcap = n;
+	}
+	return 0;
+}
+
+static void freesweepbuffers(struct sweepbuffers *sb) {
+	free(sb->band);
+	free(sb->bandrows);
+	free(sb->rightbuffer);
+	free(sb->botbuffer);
+	free(sb->tempbotbuffer);
+	free(sb->numred);
+	free(sb->numblue);
+}
+
+/* Whether any whole tile of the band has maxcells red or blue cars. Unlike counttiles this prints
+	nothing, since a sweep only records how each run ended. */
+static int tilesover(struct sweepbuffers *sb, int rows, int width, int tilesize, int maxcells) {
+	int tilecols = width / tilesize;
+	for (int top = 0; top + tilesize <= rows; top += tilesize) {
+		memset(sb->numred, 0, tilecols * sizeof(int));
+		memset(sb->numblue, 0, tilecols * sizeof(int));
+		for (int x = top; x < top + tilesize; x++) {
+			int *row = sb->bandrows[x];
+			for (int y = 0; y < tilecols * tilesize; y++) {
+				if (row[y] == 1) {
+					sb->numred[y / tilesize]++;
+				} else if (row[y] == 2) {
+					sb->numblue[y / tilesize]++;
+				}
+			}
+		}
+		for (int tile = 0; tile < tilecols; tile++) {
+			if (sb->numred[tile] >= maxcells || sb->numblue[tile] >= maxcells) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/* Runs one configuration on the processes of comm, each taking a band of whole rows of tiles.
+	There is one process across the board, so the red turn's buffer is the band's own left column,
+	and the blue turn exchanges rows with the bands above and below as the 2D path does. */
+static int solverun(struct sweepbuffers *sb, struct sweepresult *res, int maxiters, MPI_Comm comm) {
+	int rank, size;
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+	int n = res->n, t = res->t;
+	int tiledimension = n / t;
+	int maxcells = (int)(t * t * res->c + 1);
+	int active = size < tiledimension ? size : tiledimension;		// Processes with at least one row of tiles
+
+	int first = rank < active ? (int)((long long)tiledimension * rank / active) * t : n;
+	int last = rank < active - 1 ? (int)((long long)tiledimension * (rank + 1) / active) * t : n;
+	int rows = last - first;
+	if (fitsweepbuffers(sb, rows, n) == -1) {
+		return -1;
+	}
+
+	// Each process makes its own rows, with the density split evenly between red and blue
+	struct boardrng rng;
+	initboardrng(&rng, res->seed, 0, res->density / 2, res->density / 2);
+	fillboard(&rng, sb->bandrows, rows, n, first, 0);
+
+	int up = (rank + active - 1) % active;
+	int down = (rank + 1) % active;
+	int **band = sb->bandrows;
+	double start = MPI_Wtime();
+	int curriter = 0;
+	res->outcome = OUTCOME_MAXITERS;
+	while (curriter < maxiters) {
+		int local[2] = { 0, 0 };				// Tile over the threshold, cars moved
+		int all[2];
+		if (rank < active) {
+			for (int x = 0; x < rows; x++) {
+				sb->rightbuffer[x] = band[x][0];
+			}
+			solveredturn(band, sb->rightbuffer, rows, n);
+			local[1] += setemptycells(band, rows, n, 1);
+			updateleftrow(band, sb->rightbuffer, rows);
+
+			MPI_Sendrecv(band[0], n, MPI_INT, up, 1, sb->botbuffer, n, MPI_INT, down, 1, comm, MPI_STATUS_IGNORE);
+			solveblueturn(band, sb->botbuffer, rows, n);
+			local[1] += setemptycells(band, rows, n, 2);
+			MPI_Sendrecv(sb->botbuffer, n, MPI_INT, down, 2, sb->tempbotbuffer, n, MPI_INT, up, 2, comm, MPI_STATUS_IGNORE);
+			updatetoprow(band[0], sb->tempbotbuffer, n);
+
+			local[0] = tilesover(sb, rows, n, t, maxcells);
+		}
+		MPI_Allreduce(local, all, 2, MPI_INT, MPI_MAX, comm);
+		if (all[0]) {
+			res->outcome = OUTCOME_EXCEEDED;
+			break;
+		}
+		curriter++;
+		if (!all[1]) {
+			res->outcome = OUTCOME_JAMMED;
+			break;
+		}
+	}
+	res->ranks = active;
+	res->iterations = curriter;
+	res->seconds = MPI_Wtime() - start;
+	return 0;
+}
+
+static const char *outcomename(int outcome) {
+	if (outcome == OUTCOME_EXCEEDED) {
+		return "exceeded";
+	} else if (outcome == OUTCOME_JAMMED) {
+		return "jammed";
+	}
+	return "maxiters";
+}
+
+/* Runs every combination of the n, t and c lists in argv[1..3] and the -density and -seeds lists, each
+	for argv[4] iterations. The processes are split into groups of opts->group, and each group takes
+	every numgroups-th run. The first process of each group keeps its rows, and process 0 gathers them
+	and writes the CSV in run order. Returns -1 if the lists can't be read or the file can't be written. */
+int runsweep(struct options *opts, char **argv) {
+	int rank, worldsize;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &worldsize);
+	int maxiters = strtol(argv[4], NULL, 10);
+
+	const char *specs[5] = { argv[1], argv[2], argv[3], opts->densities ? opts->densities : "0.67", opts->seeds };
+	double *values[5];
+	int numvalues[5];
+	for (int i = 0; i < 5; i++) {
+		numvalues[i] = parsespec(specs[i], &values[i]);
+		if (numvalues[i] == -1) {
+			if (rank == 0) {
+				printf("Can't read sweep values %s\n", specs[i]);
+			}
+			return -1;
+		}
+	}
+
+	// The seeds are read as doubles, which hold every whole number up to 2^53 exactly
+	for (int s = 0; s < numvalues[4]; s++) {
+		if (values[4][s] < 0 || values[4][s] > 9007199254740992.0 || values[4][s] != (long long)values[4][s]) {
+			if (rank == 0) {
+				printf("Sweep seeds must be whole numbers from 0 to 2^53\n");
+			}
+			for (int i = 0; i < 5; i++) {
+				free(values[i]);
+			}
+			return -1;
+		}
+	}
+
+	// Every combination, leaving out tiles bigger than the board
+	int maxruns = numvalues[0] * numvalues[1] * numvalues[2] * numvalues[3] * numvalues[4];
+	struct sweepresult *runs = malloc(maxruns * sizeof(struct sweepresult));
+	int numruns = 0;
+	for (int a = 0; a < numvalues[0]; a++) {
+		for (int b = 0; b < numvalues[1]; b++) {
+			int n = (int)(values[0][a] + 0.5), t = (int)(values[1][b] + 0.5);
+			if (n < 1 || t < 1 || t > n) {
+				continue;
+			}
+			for (int c = 0; c < numvalues[2]; c++) {
+				for (int d = 0; d < numvalues[3]; d++) {
+					for (int s = 0; s < numvalues[4]; s++) {
+						struct sweepresult *res = &runs[numruns];
+						res->run = numruns++;
+						res->n = n;
+						res->t = t;
+						res->c = values[2][c];
+						res->density = values[3][d];
+						res->seed = (long long)values[4][s];
+					}
+				}
+			}
+		}
+	}
+	for (int i = 0; i < 5; i++) {
+		free(values[i]);
+	}
+
+	int numgroups = worldsize / opts->group;
+	if (numgroups == 0) {
+		if (rank == 0) {
+			printf("Group of %d processes is bigger than the %d processes\n", opts->group, worldsize);
+		}
+		free(runs);
+		return -1;
+	}
+	int group = rank < numgroups * opts->group ? rank / opts->group : MPI_UNDEFINED;
+	MPI_Comm groupcomm, leadercomm;
+	MPI_Comm_split(MPI_COMM_WORLD, group, rank, &groupcomm);
+	int grouprank = -1;
+	if (groupcomm != MPI_COMM_NULL) {
+		MPI_Comm_rank(groupcomm, &grouprank);
+	}
+	MPI_Comm_split(MPI_COMM_WORLD, grouprank == 0 ? 0 : MPI_UNDEFINED, rank, &leadercomm);
+	if (rank == 0) {
+		printf("Sweeping %d runs of %d iterations with %d groups of %d processes\n", numruns, maxiters, numgroups, opts->group);
+	}
+
+	int result = 0;
+	int numdone = 0;
+	struct sweepresult *done = malloc((numruns / numgroups + 1) * sizeof(struct sweepresult));
+	if (groupcomm != MPI_COMM_NULL) {
+		struct sweepbuffers sb;
+		memset(&sb, 0, sizeof(sb));
+		for (int i = group; i < numruns; i += numgroups) {
+			if (solverun(&sb, &runs[i], maxiters, groupcomm) == -1) {
+				printf("Could not allocate the grids for run %d\n", i);
+				MPI_Abort(MPI_COMM_WORLD, 1);
+			}
+			if (grouprank == 0) {
+				done[numdone++] = runs[i];
+			}
+		}
+		freesweepbuffers(&sb);
+		MPI_Comm_free(&groupcomm);
+	}
+
+	if (leadercomm != MPI_COMM_NULL) {
+		int numleaders;
+		MPI_Comm_size(leadercomm, &numleaders);
+		int bytes = numdone * sizeof(struct sweepresult);
+		int *counts = malloc(numleaders * sizeof(int));
+		int *displs = malloc(numleaders * sizeof(int));
+		MPI_Gather(&bytes, 1, MPI_INT, counts, 1, MPI_INT, 0, leadercomm);
+		struct sweepresult *all = NULL;
+		if (rank == 0) {
+			displs[0] = 0;
+			for (int i = 1; i < numleaders; i++) {
+				displs[i] = displs[i - 1] + counts[i - 1];
+			}
+			all = malloc(numruns * sizeof(struct sweepresult));
+		}
+		MPI_Gatherv(done, bytes, MPI_BYTE, all, counts, displs, MPI_BYTE, 0, leadercomm);
+
+		if (rank == 0) {
+			for (int i = 0; i < numruns; i++) {		// Back into run order
+				runs[all[i].run] = all[i];
+			}
+			FILE *csv = fopen(opts->sweepfile, "w");
+			if (!csv) {
+				printf("Could not open %s\n", opts->sweepfile);
+				result = -1;
+			} else {
+				fprintf(csv, "run,n,t,c,density,seed,ranks,iterations,outcome,seconds\n");
+				for (int i = 0; i < numruns; i++) {
+					struct sweepresult *res = &runs[i];
+					fprintf(csv, "%d,%d,%d,%g,%g,%lld,%d,%d,%s,%f\n", res->run, res->n, res->t, res->c, res->density,
+						res->seed, res->ranks, res->iterations, outcomename(res->outcome), res->seconds);
+				}
+				fclose(csv);
+				printf("Wrote %d runs to %s\n", numruns, opts->sweepfile);
+			}
+			free(all);
+		}
+		free(counts);
+		free(displs);
+		MPI_Comm_free(&leadercomm);
+	}
+	free(done);
+	free(runs);
+	return result;
+}
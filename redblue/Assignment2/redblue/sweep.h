@@ -0,0 +1,29 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "redblueoptions.h"
+
+// How a run of a sweep ended
+#define OUTCOME_MAXITERS	0		// Ran all the iterations
+#define OUTCOME_EXCEEDED	1		// A tile reached the threshold
+#define OUTCOME_JAMMED		2		// No car moved in an iteration, so the board never changes again
+
+/* One run of a sweep, and one row of its CSV file. */
+struct sweepresult {
+	int run;
+	int n;
+	int t;
+	float c;
+	float density;
+	long long seed;
+	int ranks;					// Processes the board was split over
+	int iterations;
+	int outcome;
+	double seconds;
+};
+
+int parsespec(const char *spec, double **values);
+
+int runsweep(struct options *opts, char **argv);
+
+#endif
@@ -0,0 +1,248 @@
+#include "threadpool.h"
+#include "redblueprocedure.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void *threadmain(void *arg) {
+	struct threadstart *start = arg;
+	struct threadpool *pool = start->pool;
+	int seen = 0;
+	while (1) {
+		pthread_mutex_lock(&pool->lock);
+		while (pool->generation == seen && !pool->stop) {
+			pthread_cond_wait(&pool->wake, &pool->lock);
+		}
+		if (pool->stop) {
+			pthread_mutex_unlock(&pool->lock);
+			return NULL;
+		}
+		seen = pool->generation;
+		void (*job)(void *, int, int) = pool->job;
+		void *jobarg = pool->arg;
+		pthread_mutex_unlock(&pool->lock);
+
+		job(jobarg, start->index, pool->numthreads);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->running == 0) {
+			pthread_cond_signal(&pool->finished);
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+/* Starts numthreads - 1 threads; the caller is the last one. */
+int createthreadpool(struct threadpool *pool, int numthreads) {
+	pool->numthreads = numthreads;
+	pool->generation = 0;
+	pool->running = 0;
+	pool->stop = 0;
+	pool->threads = malloc(numthreads * sizeof(pthread_t));
+	pool->starts = malloc(numthreads * sizeof(struct threadstart));
+	if (!pool->threads || !pool->starts) {
+		free(pool->threads);
+		free(pool->starts);
+		return -1;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	pthread_cond_init(&pool->finished, NULL);
+	for (int i = 1; i < numthreads; i++) {
+		pool->starts[i].pool = pool;
+		pool->starts[i].index = i;
+		if (pthread_create(&pool->threads[i], NULL, threadmain, &pool->starts[i]) != 0) {
+			pool->numthreads = i;				// Stop the ones already running
+			freethreadpool(pool);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void freethreadpool(struct threadpool *pool) {
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+	for (int i = 1; i < pool->numthreads; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->wake);
+	pthread_cond_destroy(&pool->finished);
+	free(pool->threads);
+	free(pool->starts);
+	pool->threads = NULL;
+	pool->starts = NULL;
+}
+
+/* Runs job on every thread of the pool, returning once they have all finished. */
+void runthreadpool(struct threadpool *pool, void (*job)(void *arg, int index, int count), void *arg) {
+	pthread_mutex_lock(&pool->lock);
+	pool->job = job;
+	pool->arg = arg;
+	pool->running = pool->numthreads - 1;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	job(arg, 0, pool->numthreads);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->running > 0) {
+		pthread_cond_wait(&pool->finished, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/* Gives thread index of count its share of size rows or columns, starting and ending on tile edges
+	so no two threads update the same tile. */
+static void splitrange(int size, int tilesize, int index, int count, int *first, int *last) {
+	int tiles = (size + tilesize - 1) / tilesize;
+	*first = (int)((long long)tiles * index / count) * tilesize;
+	*last = (int)((long long)tiles * (index + 1) / count) * tilesize;
+	if (*first > size) {
+		*first = size;
+	}
+	if (*last > size || index == count - 1) {
+		*last = size;
+	}
+}
+
+struct turnjob {
+	int **subgrid;
+	int *buffer;
+	int height;
+	int width;
+	int color;
+	struct tilecounts *counts;
+};
+
+static void rowturnjob(void *arg, int index, int count) {
+	struct turnjob *job = arg;
+	int first, last;
+	splitrange(job->height, job->counts ? job->counts->tilesize : 1, index, count, &first, &last);
+	if (first == last) {
+		return;
+	}
+	solverowturn(job->subgrid + first, job->buffer ? job->buffer + first : NULL, last - first, job->width, job->color);
+	if (job->counts) {
+		countrowcrossingsrows(job->counts, NULL, job->subgrid, first, last, job->width, job->color, job->color == 2, !job->buffer);
+	}
+	setemptycells(job->subgrid + first, last - first, job->width, job->color);
+}
+
+/* Red turn with marker stepping, each thread taking a band of rows. Rows are independent, since a car
+	only moves along its own row and the wrap and buffer cell are in the same row. */
+void threadedrowturn(struct threadpool *pool, int **subgrid, int *rightbuffer, int height, int width, int color, struct tilecounts *counts) {
+	struct turnjob job = { subgrid, rightbuffer, height, width, color, counts };
+	runthreadpool(pool, rowturnjob, &job);
+}
+
+static void columnturnjob(void *arg, int index, int count) {
+	struct turnjob *job = arg;
+	int first, last;
+	splitrange(job->width, job->counts ? job->counts->tilesize : 1, index, count, &first, &last);
+	if (first == last) {
+		return;
+	}
+	solveblueturncolumns(job->subgrid, job->buffer, job->height, first, last);
+	if (job->counts) {
+		countcolumncrossingscolumns(job->counts, NULL, job->subgrid, job->height, first, last, !job->buffer);
+	}
+	for (int x = 0; x < job->height; x++) {		// setemptycells for this band of columns
+		int *row = job->subgrid[x];
+		for (int y = first; y < last; y++) {
+			if (row[y] == 4) {
+				row[y] = 0;
+			} else if (row[y] == 3) {
+				row[y] = 2;
+			}
+		}
+	}
+}
+
+/* Blue turn with marker stepping, each thread taking a band of columns. */
+void threadedcolumnturn(struct threadpool *pool, int **subgrid, int *botbuffer, int height, int width, struct tilecounts *counts) {
+	struct turnjob job = { subgrid, botbuffer, height, width, 2, counts };
+	runthreadpool(pool, columnturnjob, &job);
+}
+
+struct countjob {
+	int **grid;
+	int height;
+	int width;
+	int tilesize;
+	int tilecols;
+	int *numred;
+	int *numblue;
+};
+
+static void countjob(void *arg, int index, int count) {
+	struct countjob *job = arg;
+	int first, last;
+	splitrange(job->height, job->tilesize, index, count, &first, &last);
+	for (int x = first; x < last; x++) {
+		int *row = job->grid[x];
+		int *numred = job->numred + (x / job->tilesize) * job->tilecols;
+		int *numblue = job->numblue + (x / job->tilesize) * job->tilecols;
+		for (int y = 0; y < job->width; y++) {
+			if (row[y] == 1) {
+				numred[y / job->tilesize]++;
+			} else if (row[y] == 2) {
+				numblue[y / job->tilesize]++;
+			}
+		}
+	}
+}
+
+/* counttiles with each thread counting a band of tile rows. The tiles are then checked by the
+	calling thread, so exceeding tiles are reported in the same order and format. */
+int threadedcounttiles(struct threadpool *pool, int **localgrid, int height, int width, int toprowindex, int leftcolindex, int tilesize, int tiledimension, int maxcells) {
+	int tilerows = (height + tilesize - 1) / tilesize;
+	int tilecols = (width + tilesize - 1) / tilesize;
+	struct countjob job = { localgrid, height, width, tilesize, tilecols, NULL, NULL };
+	job.numred = calloc(tilerows * tilecols, sizeof(int));
+	job.numblue = calloc(tilerows * tilecols, sizeof(int));
+	runthreadpool(pool, countjob, &job);
+
+	int result = 0;
+	for (int i = 0; i < height / tilesize; i++) {			// Only whole tiles are checked, as in counttiles
+		for (int j = 0; j < width / tilesize; j++) {
+			int tile = i * tilecols + j;
+			int tilenum = (toprowindex / tilesize + i) * tiledimension + (leftcolindex / tilesize + j);
+			if (job.numred[tile] >= maxcells || job.numblue[tile] >= maxcells) {
+				printf("Tile %d exceeded max @ red:%d, blue:%d\n", tilenum, job.numred[tile], job.numblue[tile]);
+				result = -1;
+			}
+		}
+	}
+	free(job.numred);
+	free(job.numblue);
+	return result;
+}
+
+struct filljob {
+	struct boardrng *rng;
+	int **grid;
+	int height;
+	int width;
+	int toprow;
+	int leftcol;
+};
+
+static void filljob(void *arg, int index, int count) {
+	struct filljob *job = arg;
+	int first, last;
+	splitrange(job->height, 1, index, count, &first, &last);
+	if (first < last) {
+		fillboard(job->rng, job->grid + first, last - first, job->width, job->toprow + first, job->leftcol);
+	}
+}
+
+/* fillboard with each thread making a band of rows. Each cell only depends on its coordinates, so the
+	board is the same as with one thread. */
+void threadedfillboard(struct threadpool *pool, struct boardrng *rng, int **grid, int height, int width, int toprow, int leftcol) {
+	struct filljob job = { rng, grid, height, width, toprow, leftcol };
+	runthreadpool(pool, filljob, &job);
+}
@@ -0,0 +1,45 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <pthread.h>
+#include "tilecount.h"
+#include "rng.h"
+
+struct threadpool;
+
+struct threadstart {
+	struct threadpool *pool;
+	int index;
+};
+
+/* Threads kept for the whole run, each calling job(arg, index, numthreads) once per runthreadpool.
+	The calling thread is thread 0, so only it ever makes MPI calls (MPI_THREAD_FUNNELED). */
+struct threadpool {
+	int numthreads;
+	pthread_t *threads;
+	struct threadstart *starts;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t finished;
+	void (*job)(void *arg, int index, int count);
+	void *arg;
+	int generation;				// Bumped for each job, so waiting threads know there is a new one
+	int running;				// Threads still on the current job, not counting thread 0
+	int stop;
+};
+
+int createthreadpool(struct threadpool *pool, int numthreads);
+
+void freethreadpool(struct threadpool *pool);
+
+void runthreadpool(struct threadpool *pool, void (*job)(void *arg, int index, int count), void *arg);
+
+void threadedrowturn(struct threadpool *pool, int **subgrid, int *rightbuffer, int height, int width, int color, struct tilecounts *counts);
+
+void threadedcolumnturn(struct threadpool *pool, int **subgrid, int *botbuffer, int height, int width, struct tilecounts *counts);
+
+int threadedcounttiles(struct threadpool *pool, int **localgrid, int height, int width, int toprowindex, int leftcolindex, int tilesize, int tiledimension, int maxcells);
+
+void threadedfillboard(struct threadpool *pool, struct boardrng *rng, int **grid, int height, int width, int toprow, int leftcol);
+
+#endif
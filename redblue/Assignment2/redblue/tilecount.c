@@ -0,0 +1,160 @@
+#include "tilecount.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Allocates zeroed counts for the tiles of a height x width subgrid whose top left cell is at
+	(toprowindex, leftcolindex) in the whole grid. Only whole tiles are counted, as in counttiles. */
+int malloctilecounts(struct tilecounts *tc, int height, int width, int tilesize, int toprowindex, int leftcolindex, int tiledimension) {
+	tc->tilesize = tilesize;
+	tc->tilerows = height / tilesize;
+	tc->tilecols = width / tilesize;
+	tc->firsttilerow = toprowindex / tilesize;
+	tc->firsttilecol = leftcolindex / tilesize;
+	tc->tiledimension = tiledimension;
+	tc->numred = calloc(tc->tilerows * tc->tilecols, sizeof(int));
+	tc->numblue = calloc(tc->tilerows * tc->tilecols, sizeof(int));
+	if (!tc->numred || !tc->numblue) {
+		freetilecounts(tc);
+		return -1;
+	}
+	return 0;
+}
+
+void freetilecounts(struct tilecounts *tc) {
+	free(tc->numred);
+	free(tc->numblue);
+	tc->numred = tc->numblue = NULL;
+}
+
+/* Adds delta to the count for the tile holding cell (x, y) of the subgrid, if it is in a whole tile. */
+void addtilecount(struct tilecounts *tc, int color, int x, int y, int delta) {
+	if (x >= tc->tilerows * tc->tilesize || y >= tc->tilecols * tc->tilesize) {
+		return;
+	}
+	int tile = (x / tc->tilesize) * tc->tilecols + (y / tc->tilesize);
+	if (color == 1) {
+		tc->numred[tile] += delta;
+	} else {
+		tc->numblue[tile] += delta;
+	}
+}
+
+/* Sets the counts with one full scan of the subgrid. */
+void filltilecounts(struct tilecounts *tc, int **grid, int height, int width) {
+	for (int i = 0; i < tc->tilerows * tc->tilecols; i++) {
+		tc->numred[i] = tc->numblue[i] = 0;
+	}
+	for (int x = 0; x < height; x++) {
+		for (int y = 0; y < width; y++) {
+			if (grid[x][y] == 1 || grid[x][y] == 2) {
+				addtilecount(tc, grid[x][y], x, y, 1);
+			}
+		}
+	}
+}
+
+/* Did a car of the given color move into (x, y) this half-turn? Without an old grid the turn
+	was solved in place, and the cell still holds its moved in marker. */
+static int arrived(int **oldgrid, int **grid, int x, int y, int color) {
+	if (!oldgrid) {
+		return grid[x][y] == 3;
+	}
+	return grid[x][y] == color && oldgrid[x][y] == 0;
+}
+
+/* Did a car of the given color move out of (x, y) this half-turn? */
+static int departed(int **oldgrid, int **grid, int x, int y, int color) {
+	if (!oldgrid) {
+		return grid[x][y] == 4;
+	}
+	return oldgrid[x][y] == color && grid[x][y] == 0;
+}
+
+/* Updates the counts after a half-turn moving cells right, checking only the first column of each tile
+	and the last column. Call it before the moved markers are cleared, or with the old grid when ping-pong
+	stepping. A transposed grid is the blue turn in the dual layout, so its rows are the subgrid's columns.
+	If wraps is set there was no buffer, so cars leaving the last column arrived in column 0; otherwise
+	they went to the neighbour. */
+void countrowcrossings(struct tilecounts *tc, int **oldgrid, int **grid, int height, int width, int color, int transposed, int wraps) {
+	countrowcrossingsrows(tc, oldgrid, grid, 0, height, width, color, transposed, wraps);
+}
+
+/* countrowcrossings for rows firstrow to lastrow - 1 only. Ranges starting on a tile edge touch
+	different counts, so they can be counted at the same time. */
+void countrowcrossingsrows(struct tilecounts *tc, int **oldgrid, int **grid, int firstrow, int lastrow, int width, int color, int transposed, int wraps) {
+	for (int x = firstrow; x < lastrow; x++) {
+		for (int y = tc->tilesize; y < width; y += tc->tilesize) {
+			if (arrived(oldgrid, grid, x, y, color)) {
+				addtilecount(tc, color, transposed ? y : x, transposed ? x : y, 1);
+				addtilecount(tc, color, transposed ? y - 1 : x, transposed ? x : y - 1, -1);
+			}
+		}
+		if (departed(oldgrid, grid, x, width - 1, color)) {
+			addtilecount(tc, color, transposed ? width - 1 : x, transposed ? x : width - 1, -1);
+			if (wraps) {
+				addtilecount(tc, color, transposed ? 0 : x, transposed ? x : 0, 1);
+			}
+		}
+	}
+}
+
+/* Updates the counts after a blue half-turn, checking only the first row of each tile and the last row. */
+void countcolumncrossings(struct tilecounts *tc, int **oldgrid, int **grid, int height, int width, int wraps) {
+	countcolumncrossingscolumns(tc, oldgrid, grid, height, 0, width, wraps);
+}
+
+/* countcolumncrossings for columns firstcol to lastcol - 1 only. */
+void countcolumncrossingscolumns(struct tilecounts *tc, int **oldgrid, int **grid, int height, int firstcol, int lastcol, int wraps) {
+	for (int x = tc->tilesize; x < height; x += tc->tilesize) {
+		for (int y = firstcol; y < lastcol; y++) {
+			if (arrived(oldgrid, grid, x, y, 2)) {
+				addtilecount(tc, 2, x, y, 1);
+				addtilecount(tc, 2, x - 1, y, -1);
+			}
+		}
+	}
+	for (int y = firstcol; y < lastcol; y++) {
+		if (departed(oldgrid, grid, height - 1, y, 2)) {
+			addtilecount(tc, 2, height - 1, y, -1);
+			if (wraps) {
+				addtilecount(tc, 2, 0, y, 1);
+			}
+		}
+	}
+}
+
+/* Counts the cars a neighbour moved into this subgrid, as marked with a 3 in the buffer it sent back.
+	Red cars arrive down the left column, blue cars along the top row. */
+void countbuffercrossings(struct tilecounts *tc, int *buffer, int size, int color) {
+	for (int i = 0; i < size; i++) {
+		if (buffer[i] == 3) {
+			addtilecount(tc, color, color == 1 ? i : 0, color == 1 ? 0 : i, 1);
+		}
+	}
+}
+
+/* Checks each tile against the threshold, reporting exceeding tiles in the same order and format as counttiles. */
+int checktilecounts(struct tilecounts *tc, int maxcells) {
+	int result = 0;
+	for (int i = 0; i < tc->tilerows; i++) {
+		for (int j = 0; j < tc->tilecols; j++) {
+			int tile = i * tc->tilecols + j;
+			int tilenum = (tc->firsttilerow + i) * tc->tiledimension + (tc->firsttilecol + j);
+			if (tc->numred[tile] >= maxcells || tc->numblue[tile] >= maxcells) {
+				printf("Tile %d exceeded max @ red:%d, blue:%d\n", tilenum, tc->numred[tile], tc->numblue[tile]);
+				result = -1;
+			}
+		}
+	}
+	return result;
+}
+
+/* As checktilecounts without the report, for a check whose result may be thrown away. */
+int tilecountsover(struct tilecounts *tc, int maxcells) {
+	for (int tile = 0; tile < tc->tilerows * tc->tilecols; tile++) {
+		if (tc->numred[tile] >= maxcells || tc->numblue[tile] >= maxcells) {
+			return -1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef TILECOUNT_H
+#define TILECOUNT_H
+
+/* Red and blue counts for each tile of a subgrid, kept up to date as cars cross tile edges
+	so the threshold check does not have to rescan every cell. */
+struct tilecounts {
+	int tilesize;
+	int tilerows;				// Tiles down the subgrid
+	int tilecols;				// Tiles across the subgrid
+	int firsttilerow;			// Global tile row and column of the top left tile
+	int firsttilecol;
+	int tiledimension;			// Tiles in each dimension of the whole grid
+	int *numred;
+	int *numblue;
+};
+
+int malloctilecounts(struct tilecounts *tc, int height, int width, int tilesize, int toprowindex, int leftcolindex, int tiledimension);
+
+void freetilecounts(struct tilecounts *tc);
+
+void addtilecount(struct tilecounts *tc, int color, int x, int y, int delta);
+
+void filltilecounts(struct tilecounts *tc, int **grid, int height, int width);
+
+void countrowcrossings(struct tilecounts *tc, int **oldgrid, int **grid, int height, int width, int color, int transposed, int wraps);
+
+void countrowcrossingsrows(struct tilecounts *tc, int **oldgrid, int **grid, int firstrow, int lastrow, int width, int color, int transposed, int wraps);
+
+void countcolumncrossings(struct tilecounts *tc, int **oldgrid, int **grid, int height, int width, int wraps);
+
+void countcolumncrossingscolumns(struct tilecounts *tc, int **oldgrid, int **grid, int height, int firstcol, int lastcol, int wraps);
+
+void countbuffercrossings(struct tilecounts *tc, int *buffer, int size, int color);
+
+int checktilecounts(struct tilecounts *tc, int maxcells);
+
+int tilecountsover(struct tilecounts *tc, int maxcells);
+
+#endif
@@ -0,0 +1,208 @@
+#include "tilesched.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Allocates the scheduler for a height x width subgrid, with every tile mobile. */
+int malloctilescheduler(struct tilescheduler *ts, struct threadpool *pool, int height, int width, int tilesize) {
+	ts->pool = pool;
+	ts->height = height;
+	ts->width = width;
+	ts->tilesize = tilesize;
+	ts->tilerows = (height + tilesize - 1) / tilesize;
+	ts->tilecols = (width + tilesize - 1) / tilesize;
+	int numtiles = ts->tilerows * ts->tilecols;
+	ts->redmoves = malloc(numtiles * sizeof(int));
+	ts->bluemoves = malloc(numtiles * sizeof(int));
+	ts->tasks = malloc(numtiles * sizeof(int));
+	ts->first = malloc((pool->numthreads + 1) * sizeof(int));
+	ts->next = malloc(pool->numthreads * sizeof(int));
+	if (!ts->redmoves || !ts->bluemoves || !ts->tasks || !ts->first || !ts->next) {
+		freetilescheduler(ts);
+		return -1;
+	}
+	for (int i = 0; i < numtiles; i++) {
+		ts->redmoves[i] = ts->bluemoves[i] = 1;
+	}
+	return 0;
+}
+
+void freetilescheduler(struct tilescheduler *ts) {
+	free(ts->redmoves);
+	free(ts->bluemoves);
+	free(ts->tasks);
+	free(ts->first);
+	free(ts->next);
+	ts->redmoves = ts->bluemoves = ts->tasks = ts->first = ts->next = NULL;
+}
+
+/* Marks every tile mobile, after cells were changed other than by a half-turn (eg a ghost zone exchange). */
+void waketiles(struct tilescheduler *ts) {
+	for (int i = 0; i < ts->tilerows * ts->tilecols; i++) {
+		ts->redmoves[i] = ts->bluemoves[i] = 1;
+	}
+}
+
+/* Whether a tile's next half-turn is a copy. Tiles next to the edge of the subgrid are always solved,
+	since buffer and wraparound moves there aren't counted in the moves arrays. */
+static int jammed(struct tilescheduler *ts, int i, int j, int di, int dj) {
+	if (i < 2 || i > ts->tilerows - 3 || j < 2 || j > ts->tilecols - 3) {
+		return 0;
+	}
+	for (int k = -1; k <= 1; k++) {
+		int tile = (i + k * di) * ts->tilecols + (j + k * dj);
+		if (ts->redmoves[tile] || ts->bluemoves[tile]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Splits the tiles into one group per thread, putting the mobile tiles of each group first. */
+static void buildtasks(struct tilescheduler *ts, int di, int dj) {
+	int numthreads = ts->pool->numthreads;
+	int numtiles = ts->tilerows * ts->tilecols;
+	int k = 0;
+	for (int g = 0; g < numthreads; g++) {
+		int start = (int)((long long)numtiles * g / numthreads);
+		int end = (int)((long long)numtiles * (g + 1) / numthreads);
+		ts->first[g] = k;
+		ts->next[g] = 0;
+		for (int pass = 0; pass < 2; pass++) {
+			for (int tile = start; tile < end; tile++) {
+				int isjammed = jammed(ts, tile / ts->tilecols, tile % ts->tilecols, di, dj);
+				if (isjammed == pass) {
+					ts->tasks[k++] = isjammed ? -1 - tile : tile;
+				}
+			}
+		}
+	}
+	ts->first[numthreads] = k;
+}
+
+struct schedjob {
+	struct tilescheduler *ts;
+	int **oldgrid;
+	int **newgrid;
+	int *buffer;
+	int color;
+	struct tilecounts *counts;
+};
+
+/* Does the car at (x, y) leave its cell this red (or transposed blue) half-turn? Reads only the old grid:
+	without a buffer the last column wraps against the new state of column 0, which is empty if it was
+	already empty or its own car moves on. */
+static int rowleaves(struct schedjob *job, int x, int y) {
+	int *old = job->oldgrid[x];
+	int width = job->ts->width;
+	if (old[y] != job->color) {
+		return 0;
+	}
+	if (y < width - 1) {
+		return old[y + 1] == 0;
+	}
+	if (job->buffer) {
+		return job->buffer[x] == 0;
+	}
+	return width > 1 && (old[0] == 0 || (old[0] == job->color && old[1] == 0));
+}
+
+/* Does the blue car at (x, y) leave its cell this half-turn? */
+static int columnleaves(struct schedjob *job, int x, int y) {
+	int **old = job->oldgrid;
+	int height = job->ts->height;
+	if (old[x][y] != 2) {
+		return 0;
+	}
+	if (x < height - 1) {
+		return old[x + 1][y] == 0;
+	}
+	if (job->buffer) {
+		return job->buffer[y] == 0;
+	}
+	return height > 1 && (old[0][y] == 0 || (old[0][y] == 2 && old[1][y] == 0));
+}
+
+/* Solves one tile of the half-turn into the new grid, or copies it if it's jammed. Only this tile's
+	cells, moves and count are written, and the buffer cells of its own rows or columns. */
+static void solvetile(struct schedjob *job, int task, int horizontal) {
+	struct tilescheduler *ts = job->ts;
+	int tile = task < 0 ? -1 - task : task;
+	int t = ts->tilesize;
+	int x0 = (tile / ts->tilecols) * t, y0 = (tile % ts->tilecols) * t;
+	int x1 = x0 + t < ts->height ? x0 + t : ts->height;
+	int y1 = y0 + t < ts->width ? y0 + t : ts->width;
+	int *moves = job->color == 1 ? ts->redmoves : ts->bluemoves;
+
+	if (task < 0) {
+		for (int x = x0; x < x1; x++) {
+			memcpy(job->newgrid[x] + y0, job->oldgrid[x] + y0, (y1 - y0) * sizeof(int));
+		}
+		moves[tile] = 0;
+		return;
+	}
+
+	int changed = 0, delta = 0;
+	for (int x = x0; x < x1; x++) {
+		int *old = job->oldgrid[x];
+		int *new = job->newgrid[x];
+		for (int y = y0; y < y1; y++) {
+			int leaving, arriving;
+			if (horizontal) {
+				leaving = rowleaves(job, x, y);
+				arriving = y > 0 ? rowleaves(job, x, y - 1) : !job->buffer && rowleaves(job, x, ts->width - 1);
+				if (leaving && y == ts->width - 1 && job->buffer) {
+					job->buffer[x] = 3;
+				}
+			} else {
+				leaving = columnleaves(job, x, y);
+				arriving = x > 0 ? columnleaves(job, x - 1, y) : !job->buffer && columnleaves(job, ts->height - 1, y);
+				if (leaving && x == ts->height - 1 && job->buffer) {
+					job->buffer[y] = 3;
+				}
+			}
+			new[y] = arriving ? job->color : (leaving ? 0 : old[y]);
+			changed += new[y] != old[y];
+			delta += (new[y] == job->color) - (old[y] == job->color);
+		}
+	}
+	moves[tile] = changed;
+	if (job->counts && delta) {
+		addtilecount(job->counts, job->color, x0, y0, delta);
+	}
+}
+
+/* Each thread empties its own group, then takes what's left of the others, one tile at a time. */
+static void schedrun(struct schedjob *job, int index, int count, int horizontal) {
+	struct tilescheduler *ts = job->ts;
+	for (int i = 0; i < count; i++) {
+		int g = (index + i) % count;
+		int size = ts->first[g + 1] - ts->first[g];
+		int k;
+		while ((k = __atomic_fetch_add(&ts->next[g], 1, __ATOMIC_RELAXED)) < size) {
+			solvetile(job, ts->tasks[ts->first[g] + k], horizontal);
+		}
+	}
+}
+
+static void rowjob(void *arg, int index, int count) {
+	schedrun(arg, index, count, 1);
+}
+
+static void columnjob(void *arg, int index, int count) {
+	schedrun(arg, index, count, 0);
+}
+
+/* Red half-turn (or blue on a transposed grid) from oldgrid into newgrid, as solverowturnbuffered does,
+	keeping the tile counts up to date if given. */
+void scheduledrowturn(struct tilescheduler *ts, int **oldgrid, int **newgrid, int *rightbuffer, int color, struct tilecounts *counts) {
+	struct schedjob job = { ts, oldgrid, newgrid, rightbuffer, color, counts };
+	buildtasks(ts, 0, 1);
+	runthreadpool(ts->pool, rowjob, &job);
+}
+
+/* Blue half-turn from oldgrid into newgrid, as solveblueturnbuffered does. */
+void scheduledcolumnturn(struct tilescheduler *ts, int **oldgrid, int **newgrid, int *botbuffer, struct tilecounts *counts) {
+	struct schedjob job = { ts, oldgrid, newgrid, botbuffer, 2, counts };
+	buildtasks(ts, 1, 0);
+	runthreadpool(ts->pool, columnjob, &job);
+}
@@ -0,0 +1,35 @@
+#ifndef TILESCHED_H
+#define TILESCHED_H
+
+#include "threadpool.h"
+#include "tilecount.h"
+
+/* Runs a ping-pong half-turn as one task per tile on a thread pool. Each thread starts on its own
+	group of tiles and then takes tasks from the other groups, mobile tiles first in every group.
+	A tile is jammed if it and its neighbours along the turn changed in neither of the last two
+	half-turns, so its next half-turn is just a copy. */
+struct tilescheduler {
+	struct threadpool *pool;
+	int height;
+	int width;
+	int tilesize;
+	int tilerows;
+	int tilecols;
+	int *redmoves;				// Cells each tile changed in the last red / blue half-turn
+	int *bluemoves;
+	int *tasks;					// Tile numbers, grouped by thread; a jammed tile is stored as -1 - tile
+	int *first;					// Start of each thread's group in tasks, plus the end of the last
+	int *next;					// Next task to take from each group
+};
+
+int malloctilescheduler(struct tilescheduler *ts, struct threadpool *pool, int height, int width, int tilesize);
+
+void freetilescheduler(struct tilescheduler *ts);
+
+void waketiles(struct tilescheduler *ts);
+
+void scheduledrowturn(struct tilescheduler *ts, int **oldgrid, int **newgrid, int *rightbuffer, int color, struct tilecounts *counts);
+
+void scheduledcolumnturn(struct tilescheduler *ts, int **oldgrid, int **newgrid, int *botbuffer, struct tilecounts *counts);
+
+#endif